@@ -0,0 +1,399 @@
+/*
+ * rapl_snapshot: RAPL energy and APERF/MPERF in an mmap-able page
+ *
+ * While /dev/rapl_snapshot is mapped, every online cpu runs a pinned
+ * hrtimer that samples its own APERF and MPERF and, on one online cpu of
+ * each package, the package energy status registers. Reading local MSRs
+ * needs no IPI. The values land in a zeroed, physically contiguous buffer
+ * that the device maps read-only into userspace. See user-kernel.h for
+ * the layout and the per-slot sequence counts readers use.
+ *
+ * With nothing mapped no timer runs, so idle cpus keep their deep
+ * C-states for whatever else is measuring them. cpu hotplug callbacks
+ * start and stop a cpu's timer with it, and hand the package registers
+ * over to another cpu of the package when their reader goes offline.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/fs.h>
+#include <linux/gfp.h>
+#include <linux/hrtimer.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu-defs.h>
+#include <linux/smp.h>
+#include <linux/topology.h>
+#include <asm/msr.h>
+#include <asm/processor.h>
+
+#include "user-kernel.h"
+
+#define DEF_INTERVAL_US (1000)
+#define MIN_INTERVAL_US (100)
+
+#define MSR_AMD_RAPL_POWER_UNIT_ 0xc0010299
+#define MSR_AMD_PKG_ENERGY_STATUS_ 0xc001029b
+
+static unsigned int interval_us = DEF_INTERVAL_US;
+module_param(interval_us, uint, 0444);
+MODULE_PARM_DESC(interval_us, "sampling interval in microseconds (min 100)");
+
+static struct rapl_snapshot *snapshot;
+static unsigned int snapshot_order;
+static enum cpuhp_state snapshot_hp_state;
+
+struct snapshot_cpu {
+	struct hrtimer timer;
+	int package;		/* index into snapshot->packages[] */
+	bool reads_package;
+};
+
+static DEFINE_PER_CPU(struct snapshot_cpu, snapshot_cpus);
+
+/*
+ * snapshot_lock serializes the hotplug callbacks with the first map and
+ * the last unmap. Under it: the cpus being sampled, the live mappings,
+ * and the physical package id behind each snapshot->packages[] index.
+ */
+static DEFINE_MUTEX(snapshot_lock);
+static struct cpumask snapshot_mask;
+static unsigned int snapshot_maps;
+static int package_ids[RAPL_SNAPSHOT_MAX_PACKAGES];
+
+/* status registers in rapl_domain_names order, 0 if the vendor has none */
+static u32 energy_msrs[RAPL_SNAPSHOT_DOMAINS];
+
+static void detect_energy_msrs(void)
+{
+	if (boot_cpu_data.x86_vendor == X86_VENDOR_AMD ||
+	    boot_cpu_data.x86_vendor == X86_VENDOR_HYGON) {
+		energy_msrs[0] = MSR_AMD_PKG_ENERGY_STATUS_;
+		return;
+	}
+
+	energy_msrs[0] = MSR_PKG_ENERGY_STATUS;
+	energy_msrs[1] = MSR_PP0_ENERGY_STATUS;
+	energy_msrs[2] = MSR_DRAM_ENERGY_STATUS;
+	energy_msrs[3] = MSR_PP1_ENERGY_STATUS;
+	energy_msrs[4] = MSR_PLATFORM_ENERGY_STATUS;
+}
+
+static inline void slot_write_begin(__u32 *seq)
+{
+	WRITE_ONCE(*seq, *seq + 1);
+	smp_wmb();
+}
+
+static inline void slot_write_end(__u32 *seq)
+{
+	smp_wmb();
+	WRITE_ONCE(*seq, *seq + 1);
+}
+
+static void sample_local(struct snapshot_cpu *sc, int cpu)
+{
+	struct rapl_snapshot_cpu *c = &snapshot->cpus[cpu];
+	struct rapl_snapshot_package *p;
+	u64 aperf, mperf, energy;
+	int i;
+
+	rdmsrl(MSR_IA32_APERF, aperf);
+	rdmsrl(MSR_IA32_MPERF, mperf);
+
+	slot_write_begin(&c->seq);
+	c->time_ns = ktime_get_ns();
+	c->aperf = aperf;
+	c->mperf = mperf;
+	slot_write_end(&c->seq);
+
+	if (!READ_ONCE(sc->reads_package))
+		return;
+
+	p = &snapshot->packages[sc->package];
+	slot_write_begin(&p->seq);
+	p->time_ns = ktime_get_ns();
+	for (i = 0; i < RAPL_SNAPSHOT_DOMAINS; i++) {
+		if (!(snapshot->available & BIT(i)))
+			continue;
+		if (rdmsrl_safe(energy_msrs[i], &energy) == 0)
+			p->energy[i] = energy & 0xffffffffULL;
+	}
+	slot_write_end(&p->seq);
+}
+
+static enum hrtimer_restart snapshot_timer_fn(struct hrtimer *timer)
+{
+	struct snapshot_cpu *sc = container_of(timer, struct snapshot_cpu, timer);
+
+	sample_local(sc, smp_processor_id());
+	hrtimer_forward_now(timer, us_to_ktime(interval_us));
+
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Runs on the cpu itself so its timer is armed, and stays, there. The
+ * first sample is taken right away, readers that just mapped the page
+ * must not see values from when it was last mapped.
+ */
+static void snapshot_start_timer(void *unused)
+{
+	struct snapshot_cpu *sc = this_cpu_ptr(&snapshot_cpus);
+
+	sample_local(sc, smp_processor_id());
+	hrtimer_start(&sc->timer, us_to_ktime(interval_us), HRTIMER_MODE_REL_PINNED);
+}
+
+/* first map: every cpu being sampled starts its timer */
+static void snapshot_start(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &snapshot_mask)
+		smp_call_function_single(cpu, snapshot_start_timer, NULL, 1);
+}
+
+/* last unmap */
+static void snapshot_stop(void)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &snapshot_mask)
+		hrtimer_cancel(&per_cpu_ptr(&snapshot_cpus, cpu)->timer);
+}
+
+/*
+ * cpuhp online callback, runs on cpu. Packages are numbered densely in
+ * the order their first cpu comes online; a cpu reads its package's
+ * energy registers if no other cpu of the package does.
+ */
+static int snapshot_cpu_online(unsigned int cpu)
+{
+	struct snapshot_cpu *sc = per_cpu_ptr(&snapshot_cpus, cpu);
+	int id = topology_physical_package_id(cpu);
+	int j, other;
+
+	/* failing would keep the cpu offline, it just goes unsampled */
+	if (cpu >= RAPL_SNAPSHOT_MAX_CPUS) {
+		pr_warn("cpu %u is beyond the %d the layout has room for\n",
+			cpu, RAPL_SNAPSHOT_MAX_CPUS);
+		return 0;
+	}
+
+	mutex_lock(&snapshot_lock);
+
+	for (j = 0; j < snapshot->nr_packages && package_ids[j] != id; j++)
+		;
+	if (j == snapshot->nr_packages) {
+		if (j == RAPL_SNAPSHOT_MAX_PACKAGES) {
+			pr_warn("cpu %u is in package %d, beyond the %d the layout has room for\n",
+				cpu, id, RAPL_SNAPSHOT_MAX_PACKAGES);
+			goto unlock;
+		}
+		package_ids[j] = id;
+		snapshot->nr_packages = j + 1;
+	}
+
+	sc->package = j;
+	sc->reads_package = true;
+	for_each_cpu(other, &snapshot_mask)
+		if (per_cpu_ptr(&snapshot_cpus, other)->package == j &&
+		    per_cpu_ptr(&snapshot_cpus, other)->reads_package)
+			sc->reads_package = false;
+	if (sc->reads_package)
+		snapshot->packages[j].cpu = cpu;
+
+	snapshot->cpus[cpu].package = j;
+	if (cpu + 1 > snapshot->nr_cpus)
+		snapshot->nr_cpus = cpu + 1;
+
+	hrtimer_init(&sc->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+	sc->timer.function = snapshot_timer_fn;
+	cpumask_set_cpu(cpu, &snapshot_mask);
+	if (snapshot_maps)
+		snapshot_start_timer(NULL);
+
+unlock:
+	mutex_unlock(&snapshot_lock);
+	return 0;
+}
+
+/*
+ * cpuhp offline callback, runs on cpu before its timers would migrate.
+ * The timer is cancelled first so the package slot never has two
+ * writers; a package whose last cpu goes offline keeps its last values.
+ */
+static int snapshot_cpu_offline(unsigned int cpu)
+{
+	struct snapshot_cpu *sc = per_cpu_ptr(&snapshot_cpus, cpu);
+	int other;
+
+	mutex_lock(&snapshot_lock);
+
+	if (!cpumask_test_and_clear_cpu(cpu, &snapshot_mask))
+		goto unlock;
+	hrtimer_cancel(&sc->timer);
+
+	if (sc->reads_package) {
+		sc->reads_package = false;
+		for_each_cpu(other, &snapshot_mask) {
+			struct snapshot_cpu *osc = per_cpu_ptr(&snapshot_cpus, other);
+
+			if (osc->package != sc->package)
+				continue;
+			snapshot->packages[sc->package].cpu = other;
+			WRITE_ONCE(osc->reads_package, true);
+			break;
+		}
+	}
+
+unlock:
+	mutex_unlock(&snapshot_lock);
+	return 0;
+}
+
+/* domains whose status register reads on this cpu */
+static void snapshot_probe(void *unused)
+{
+	u64 val;
+	int i;
+
+	if (boot_cpu_data.x86_vendor == X86_VENDOR_AMD ||
+	    boot_cpu_data.x86_vendor == X86_VENDOR_HYGON)
+		rdmsrl_safe(MSR_AMD_RAPL_POWER_UNIT_, &snapshot->power_unit);
+	else
+		rdmsrl_safe(MSR_RAPL_POWER_UNIT, &snapshot->power_unit);
+
+	for (i = 0; i < RAPL_SNAPSHOT_DOMAINS; i++)
+		if (energy_msrs[i] && rdmsrl_safe(energy_msrs[i], &val) == 0)
+			snapshot->available |= BIT(i);
+}
+
+/* vm_ops open/close count the mappings, forks and splits included */
+static void snapshot_vm_open(struct vm_area_struct *vma)
+{
+	mutex_lock(&snapshot_lock);
+	if (!snapshot_maps++)
+		snapshot_start();
+	mutex_unlock(&snapshot_lock);
+}
+
+static void snapshot_vm_close(struct vm_area_struct *vma)
+{
+	mutex_lock(&snapshot_lock);
+	if (!--snapshot_maps)
+		snapshot_stop();
+	mutex_unlock(&snapshot_lock);
+}
+
+static const struct vm_operations_struct snapshot_vm_ops = {
+	.open = snapshot_vm_open,
+	.close = snapshot_vm_close,
+};
+
+static int snapshot_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (vma->vm_pgoff || size > (PAGE_SIZE << snapshot_order))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	ret = remap_pfn_range(vma, vma->vm_start,
+			      virt_to_phys(snapshot) >> PAGE_SHIFT,
+			      size, vma->vm_page_prot);
+	if (ret)
+		return ret;
+
+	/* mmap() doesn't call ->open() for the first mapping */
+	vma->vm_ops = &snapshot_vm_ops;
+	snapshot_vm_open(vma);
+
+	return 0;
+}
+
+static const struct file_operations snapshot_fops = {
+	.owner = THIS_MODULE,
+	.mmap = snapshot_mmap,
+};
+
+static struct miscdevice snapshot_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = RAPL_SNAPSHOT_DEVICE,
+	.fops = &snapshot_fops,
+	.mode = 0444,
+};
+
+static int __init rapl_snapshot_init(void)
+{
+	int ret;
+
+	if (!boot_cpu_has(X86_FEATURE_APERFMPERF)) {
+		pr_err("cpu has no APERF/MPERF\n");
+		return -ENODEV;
+	}
+
+	if (interval_us < MIN_INTERVAL_US)
+		interval_us = MIN_INTERVAL_US;
+
+	snapshot_order = get_order(sizeof(struct rapl_snapshot));
+	snapshot = (struct rapl_snapshot *)__get_free_pages(GFP_KERNEL | __GFP_ZERO,
+							    snapshot_order);
+	if (!snapshot)
+		return -ENOMEM;
+
+	snapshot->magic = RAPL_SNAPSHOT_MAGIC;
+	snapshot->version = RAPL_SNAPSHOT_VERSION;
+	snapshot->interval_us = interval_us;
+	detect_energy_msrs();
+
+	/* calls snapshot_cpu_online() on every online cpu */
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "misc/rapl_snapshot:online",
+				snapshot_cpu_online, snapshot_cpu_offline);
+	if (ret < 0)
+		goto free;
+	snapshot_hp_state = ret;
+
+	cpus_read_lock();
+	smp_call_function_single(snapshot->packages[0].cpu, snapshot_probe, NULL, 1);
+	cpus_read_unlock();
+	if (!snapshot->available)
+		pr_info("no readable energy registers, sampling APERF/MPERF only\n");
+
+	ret = misc_register(&snapshot_dev);
+	if (ret)
+		goto remove;
+
+	pr_info("%u cpus in %u packages, sampled every %u us while mapped\n",
+		snapshot->nr_cpus, snapshot->nr_packages, interval_us);
+	return 0;
+
+remove:
+	cpuhp_remove_state(snapshot_hp_state);
+free:
+	free_pages((unsigned long)snapshot, snapshot_order);
+	return ret;
+}
+
+/* nothing can be mapped any more, the module is held while it is */
+static void __exit rapl_snapshot_exit(void)
+{
+	misc_deregister(&snapshot_dev);
+	cpuhp_remove_state(snapshot_hp_state);
+	free_pages((unsigned long)snapshot, snapshot_order);
+}
+
+module_init(rapl_snapshot_init);
+module_exit(rapl_snapshot_exit);
+
+MODULE_DESCRIPTION("RAPL energy and APERF/MPERF snapshots mapped into userspace");
+MODULE_LICENSE("GPL");
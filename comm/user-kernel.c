@@ -1,12 +1,99 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
 #include "user-kernel.h"
 
+/*
+ * Maps /dev/rapl_snapshot (insmod rapl_snapshot.ko first), takes two
+ * snapshots a second apart and prints what happened in between: raw
+ * energy counts per package and APERF/MPERF per cpu, i.e. the average
+ * busy frequency as a fraction of the base frequency.
+ */
+
+static const char *domain_names[RAPL_SNAPSHOT_DOMAINS] = {
+    "energy-pkg", "energy-cores", "energy-ram", "energy-gpu", "energy-psys",
+};
+
+static const struct rapl_snapshot *map_snapshot()
+{
+    const struct rapl_snapshot *s;
+    int fd = open("/dev/" RAPL_SNAPSHOT_DEVICE, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printf("could not open /dev/%s: %s\n", RAPL_SNAPSHOT_DEVICE, strerror(errno));
+        exit(1);
+    }
+
+    s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (s == MAP_FAILED)
+    {
+        printf("could not map /dev/%s: %s\n", RAPL_SNAPSHOT_DEVICE, strerror(errno));
+        exit(1);
+    }
+
+    if (s->magic != RAPL_SNAPSHOT_MAGIC || s->version != RAPL_SNAPSHOT_VERSION)
+    {
+        printf("unknown snapshot layout %x version %u\n", s->magic, s->version);
+        exit(1);
+    }
+
+    return s;
+}
+
 int main(int argc, char* argv[])
 {
-    printf("hello\n");
+    const struct rapl_snapshot *s = map_snapshot();
+    struct rapl_snapshot_package p0[RAPL_SNAPSHOT_MAX_PACKAGES], p1;
+    struct rapl_snapshot_cpu c0[RAPL_SNAPSHOT_MAX_CPUS], c1;
+    double unit = 1.0 / (double)(1 << ((s->power_unit >> 8) & 0x1f));
+
+    printf("%u packages, %u cpus, every %u us\n\n", s->nr_packages, s->nr_cpus, s->interval_us);
+
+    for (unsigned int j = 0; j < s->nr_packages; j++)
+    {
+        rapl_snapshot_read_package(s, j, &p0[j]);
+    }
+    for (unsigned int cpu = 0; cpu < s->nr_cpus; cpu++)
+    {
+        rapl_snapshot_read_cpu(s, cpu, &c0[cpu]);
+    }
+
+    sleep(1);
+
+    for (unsigned int j = 0; j < s->nr_packages; j++)
+    {
+        rapl_snapshot_read_package(s, j, &p1);
+        for (int i = 0; i < RAPL_SNAPSHOT_DOMAINS; i++)
+        {
+            if (s->available & (1u << i))
+            {
+                // 32 bit counters
+                __u64 delta = (p1.energy[i] - p0[j].energy[i]) & 0xffffffffULL;
+                printf("package %u %-12s %.6f J over %.6f s\n", j, domain_names[i],
+                       (double)delta * unit, (double)(p1.time_ns - p0[j].time_ns) / 1e9);
+            }
+        }
+    }
+
+    for (unsigned int cpu = 0; cpu < s->nr_cpus; cpu++)
+    {
+        rapl_snapshot_read_cpu(s, cpu, &c1);
+        if (c1.time_ns == 0 || c1.mperf == c0[cpu].mperf)
+        {
+            continue;
+        }
+        printf("cpu %u (package %u) APERF/MPERF %.3f\n", cpu, c1.package,
+               (double)(c1.aperf - c0[cpu].aperf) / (double)(c1.mperf - c0[cpu].mperf));
+    }
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,103 @@
+/*
+ * Layout of the rapl_snapshot device, shared by the kernel module
+ * (rapl_snapshot.c) and its userspace readers.
+ *
+ * The module keeps a read-only mapping of a few pages that, while anyone
+ * has it mapped, every online cpu refreshes from a pinned hrtimer,
+ * reading its own MSRs: APERF and MPERF always, the package energy
+ * status registers if it is the cpu of its package chosen to read them
+ * (packages[].cpu). Readers mmap /dev/rapl_snapshot and get
+ * every package and cpu with plain loads, instead of one pread() of
+ * /dev/cpu/N/msr (and one IPI) per register per cpu.
+ *
+ * Every slot has its own sequence count, odd while its cpu rewrites it:
+ *
+ *	do {
+ *		seq = READ_ONCE(slot->seq);	(retry while odd)
+ *		rmb();
+ *		copy the slot
+ *		rmb();
+ *	} while (READ_ONCE(slot->seq) != seq);
+ *
+ * rapl_snapshot_read_package()/_cpu() below do this for userspace.
+ */
+
+#ifndef _USER_KERNEL_H
+#define _USER_KERNEL_H
+
+#include <linux/types.h>
+
+#define RAPL_SNAPSHOT_DEVICE "rapl_snapshot"
+#define RAPL_SNAPSHOT_MAGIC 0x50414e53 /* "SNAP" */
+#define RAPL_SNAPSHOT_VERSION 1
+
+#define RAPL_SNAPSHOT_MAX_PACKAGES 16
+#define RAPL_SNAPSHOT_MAX_CPUS 256
+
+/* same order as rapl_domain_names in rapl/rapl.h */
+#define RAPL_SNAPSHOT_DOMAINS 5
+
+struct rapl_snapshot_package {
+	__u32 seq;
+	__u32 cpu;		/* the cpu that reads it */
+	__u64 time_ns;		/* CLOCK_MONOTONIC */
+	__u64 energy[RAPL_SNAPSHOT_DOMAINS]; /* raw 32 bit status counts */
+};
+
+struct rapl_snapshot_cpu {
+	__u32 seq;
+	__u32 package;		/* index into packages[] */
+	__u64 time_ns;
+	__u64 aperf;
+	__u64 mperf;
+};
+
+struct rapl_snapshot {
+	__u32 magic;
+	__u32 version;
+	__u32 nr_packages;
+	__u32 nr_cpus;		/* highest cpu seen online + 1 */
+	__u32 interval_us;
+	__u32 available;	/* bit i set if energy domain i is read */
+	__u64 power_unit;	/* raw MSR_RAPL_POWER_UNIT (AMD: 0xc0010299) */
+	struct rapl_snapshot_package packages[RAPL_SNAPSHOT_MAX_PACKAGES];
+	struct rapl_snapshot_cpu cpus[RAPL_SNAPSHOT_MAX_CPUS];
+};
+
+#ifndef __KERNEL__
+
+#include <stdatomic.h>
+#include <string.h>
+
+static inline __u32 rapl_snapshot_seq(const __u32 *seq)
+{
+	return atomic_load_explicit((_Atomic __u32 *)seq, memory_order_acquire);
+}
+
+static inline void rapl_snapshot_copy(const __u32 *seq, void *out, const void *slot, size_t size)
+{
+	__u32 begin;
+
+	do {
+		while ((begin = rapl_snapshot_seq(seq)) & 1)
+			;
+		memcpy(out, slot, size);
+		atomic_thread_fence(memory_order_acquire);
+	} while (atomic_load_explicit((_Atomic __u32 *)seq, memory_order_relaxed) != begin);
+}
+
+static inline void rapl_snapshot_read_package(const struct rapl_snapshot *s, int package,
+					      struct rapl_snapshot_package *out)
+{
+	rapl_snapshot_copy(&s->packages[package].seq, out, &s->packages[package], sizeof(*out));
+}
+
+static inline void rapl_snapshot_read_cpu(const struct rapl_snapshot *s, int cpu,
+					  struct rapl_snapshot_cpu *out)
+{
+	rapl_snapshot_copy(&s->cpus[cpu].seq, out, &s->cpus[cpu], sizeof(*out));
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* _USER_KERNEL_H */
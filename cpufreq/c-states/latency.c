@@ -1,7 +1,15 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <fcntl.h>
 
+/*
+ * The kernel drops a PM QoS request when its /dev/cpu_dma_latency fd is
+ * closed, so the target only holds while this process runs. Leave it
+ * running alongside the measurement (e.g. rapl cstate) and ^C to release.
+ */
+
 int main(int argc, char* argv[])
 {
     int32_t l;
@@ -27,4 +35,9 @@ int main(int argc, char* argv[])
         perror("write to /dev/cpu_dma_latency");
         return 1;
     }
+
+    printf("holding, ^C to release\n");
+    pause();
+
+    return 0;
 }
\ No newline at end of file
@@ -9,14 +9,19 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <linux/cpu.h>
+#include <linux/debugfs.h>
 #include <linux/module.h>
 #include <linux/percpu-defs.h>
 #include <linux/slab.h>
 #include <linux/tick.h>
 #include <linux/sched/cpufreq.h>
+#include <linux/seq_file.h>
 
 #include "ondemandx.h"
 
+#define CREATE_TRACE_POINTS
+#include "ondemandx_trace.h"
+
 #define ONDEMANDX "ondemandx"
 
 /* On-demand governor macros */
@@ -27,11 +32,401 @@
 #define MICRO_FREQUENCY_MIN_SAMPLE_RATE (10000)
 #define MIN_FREQUENCY_UP_THRESHOLD (1)
 #define MAX_FREQUENCY_UP_THRESHOLD (100)
+#define DEF_PREDICT_ALPHA (50)
+#define DEF_PREDICT_BETA (30)
+#define DEF_PREDICT_PERIOD_MAX (16)
+#define MIN_PREDICT_PERIOD (2)
+/* mean load difference, in percent, below which a period counts as found */
+#define PREDICT_PERIOD_MAX_ERR (5)
+#define DEF_LOW_LATENCY_WINDOW_US (200)
+#define DEF_LOW_LATENCY_RATE_LIMIT_US (1000)
+#define MIN_LOW_LATENCY_WINDOW_US (50)
+#define DEF_TRANSITION_COST_FACTOR (4)
+#define MAX_TRANSITION_COST_FACTOR (1000)
+/* assumed when the driver reports CPUFREQ_ETERNAL and nothing was measured yet */
+#define DEF_TRANSITION_COST_NS (10 * NSEC_PER_USEC)
+#define DEF_ADAPTIVE_SPEEDUP (4)
+#define MAX_ADAPTIVE_SPEEDUP (16)
+#define DEF_ADAPTIVE_BACKOFF_MAX (8)
+#define MAX_ADAPTIVE_BACKOFF_MAX (64)
+#define DEF_ADAPTIVE_STDDEV (10)
+#define MIN_ADAPTIVE_SAMPLING_US (1000)
+/* load under which a cpu counts as idle for adaptive sampling, percent */
+#define ADAPTIVE_IDLE_LOAD (5)
 
 static struct od_ops od_ops;
 
 static unsigned int default_powersave_bias;
 
+/************************** decision log ************************/
+
+/*
+ * Every decision also goes into a small ring on the cpu that made it,
+ * with interrupts off so nothing on that cpu interleaves with a half
+ * written entry. No lock is taken; a reader racing with a writer may
+ * see an entry being overwritten, which is fine for a debugging aid.
+ */
+#define ODX_LOG_ENTRIES 256 /* power of 2 */
+
+struct odx_log_entry {
+	u64 time_ns;
+	unsigned int cpu; /* policy->cpu */
+	unsigned int load;
+	unsigned int cur;
+	unsigned int target;
+};
+
+struct odx_log {
+	unsigned long head;
+	struct odx_log_entry entries[ODX_LOG_ENTRIES];
+};
+
+static DEFINE_PER_CPU(struct odx_log, odx_log);
+
+static void odx_log_decision(unsigned int cpu, unsigned int load,
+			     unsigned int cur, unsigned int target)
+{
+	struct odx_log *log;
+	struct odx_log_entry *e;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	log = this_cpu_ptr(&odx_log);
+	e = &log->entries[log->head & (ODX_LOG_ENTRIES - 1)];
+	e->time_ns = ktime_get_ns();
+	e->cpu = cpu;
+	e->load = load;
+	e->cur = cur;
+	e->target = target;
+	smp_store_release(&log->head, log->head + 1);
+	local_irq_restore(flags);
+}
+
+/*
+ * Replaces the old printk on every sample: a tracepoint, the per-cpu log
+ * and the per-policy histograms. cur is the frequency the decision was
+ * made at, target is 0 if nothing was requested.
+ */
+static void odx_account(struct cpufreq_policy *policy, unsigned int load,
+			unsigned int predicted, unsigned int cur, unsigned int target)
+{
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy->governor_data);
+	unsigned int index;
+
+	trace_ondemandx_update(policy->cpu, load, predicted, cur, target);
+	odx_log_decision(policy->cpu, load, cur, target);
+
+	dbs_info->load_hist[min(load, 100U) / 10]++;
+	if (target && policy->freq_table) {
+		index = cpufreq_frequency_table_target(policy, target, CPUFREQ_RELATION_C);
+		if (index < ODX_MAX_FREQS)
+			dbs_info->freq_hist[index]++;
+	}
+}
+
+/************************** load prediction ************************/
+
+/*
+ * ondemand sizes the frequency for the load of the period that just
+ * ended, so it is always a period late and chases its tail on periodic
+ * loads. With a predictor set, od_update() sizes it for the load the
+ * next period is expected to have instead.
+ */
+static void odx_predict_reset(struct odx_predict *p)
+{
+	memset(p, 0, sizeof(*p));
+}
+
+static unsigned int history_at(struct odx_predict *p, unsigned int age)
+{
+	return p->history[(p->nr_samples - 1 - age) & (ODX_HISTORY - 1)];
+}
+
+/*
+ * Lag of the period that best explains the recent history, 0 if none does
+ * well enough. The window compared is whatever the longest lag leaves.
+ */
+static unsigned int odx_find_period(struct odx_predict *p, unsigned int period_max)
+{
+	unsigned int window = ODX_HISTORY - period_max;
+	unsigned int lag, i, err, best_err = UINT_MAX, best = 0;
+
+	if (p->nr_samples < ODX_HISTORY)
+		return 0;
+
+	for (lag = MIN_PREDICT_PERIOD; lag <= period_max; lag++) {
+		err = 0;
+		for (i = 0; i < window && err < best_err; i++)
+			err += abs((int)history_at(p, i) - (int)history_at(p, i + lag));
+		if (err < best_err) {
+			best_err = err;
+			best = lag;
+		}
+	}
+
+	return best_err <= PREDICT_PERIOD_MAX_ERR * window ? best : 0;
+}
+
+/* Feeds this sample's load in, returns the load expected for the next one */
+static unsigned int odx_predict_load(struct od_dbs_tuners *tuners,
+				     struct odx_predict *p, unsigned int load)
+{
+	int sample = (int)load << ODX_FP_SHIFT;
+	int alpha = tuners->predict_alpha, beta = tuners->predict_beta;
+	int level, predicted;
+	unsigned int period;
+
+	p->history[p->nr_samples & (ODX_HISTORY - 1)] = load;
+	if (p->nr_samples++ == 0) {
+		p->level = sample;
+		p->trend = 0;
+		return load;
+	}
+
+	switch (tuners->predictor) {
+	case ODX_PREDICT_EWMA:
+		p->level += alpha * (sample - p->level) / 100;
+		predicted = p->level;
+		break;
+	case ODX_PREDICT_HOLT:
+	case ODX_PREDICT_PERIODIC:
+		level = p->level + p->trend;
+		level += alpha * (sample - level) / 100;
+		p->trend += beta * ((level - p->level) - p->trend) / 100;
+		p->level = level;
+		predicted = level + p->trend;
+
+		/* the sample one period before the next one, if there is a period */
+		period = tuners->predictor == ODX_PREDICT_PERIODIC ?
+			 odx_find_period(p, tuners->predict_period_max) : 0;
+		if (period)
+			return history_at(p, period - 1);
+		break;
+	default:
+		return load;
+	}
+
+	return clamp(predicted, 0, 100 << ODX_FP_SHIFT) >> ODX_FP_SHIFT;
+}
+
+/************************** load prediction end ************************/
+
+/************************** efficiency table ************************/
+
+/*
+ * ondemand maps load linearly onto [min_freq, max_freq] as if every
+ * P-state cost the same per unit of work. With a measured table the
+ * demanded capacity is expressed in the table's performance units and
+ * met by the entry that costs the least energy per unit of work.
+ *
+ * An entry is never worth using if a faster one spends no more energy
+ * per unit of work: finishing sooner and idling beats it. Those are
+ * marked once when the table is loaded.
+ */
+static void odx_efficiency_mark(struct odx_efficiency *eff)
+{
+	struct odx_efficiency_entry *e, *f;
+	unsigned int i, j;
+
+	for (i = 0; i < eff->nr; i++) {
+		e = &eff->entries[i];
+		for (j = i + 1; j < eff->nr && !e->skip; j++) {
+			f = &eff->entries[j];
+			/* f->power / f->perf <= e->power / e->perf */
+			e->skip = f->perf >= e->perf &&
+				  (u64)f->power * e->perf <= (u64)e->power * f->perf;
+		}
+	}
+}
+
+/* Throughput the table predicts at freq, interpolated between entries */
+static u64 odx_efficiency_perf(struct odx_efficiency *eff, unsigned int freq)
+{
+	struct odx_efficiency_entry *lo = &eff->entries[0], *hi = &eff->entries[eff->nr - 1];
+	unsigned int i;
+
+	if (freq <= lo->freq)
+		return (u64)lo->perf * freq / lo->freq;
+	if (freq >= hi->freq)
+		return (u64)hi->perf * freq / hi->freq;
+
+	for (i = 1; eff->entries[i].freq < freq; i++)
+		;
+	hi = &eff->entries[i];
+	lo = &eff->entries[i - 1];
+
+	return lo->perf + (u64)(hi->perf - lo->perf) * (freq - lo->freq) /
+			  (hi->freq - lo->freq);
+}
+
+/*
+ * Lowest-energy frequency with capacity for load (percent busy at cur)
+ * while staying under up_threshold, 0 if no entry is fast enough.
+ */
+static unsigned int odx_efficiency_target(struct odx_efficiency *eff,
+					  unsigned int cur, unsigned int load,
+					  unsigned int up_threshold)
+{
+	u64 demand = odx_efficiency_perf(eff, cur) * load / up_threshold;
+	unsigned int i;
+
+	/* cost per unit of work rises with perf among the entries kept */
+	for (i = 0; i < eff->nr; i++)
+		if (!eff->entries[i].skip && eff->entries[i].perf >= demand)
+			return eff->entries[i].freq;
+
+	return 0;
+}
+
+/************************** efficiency table end ************************/
+
+/************************** transition cost ************************/
+
+/*
+ * ondemand requests a new frequency whenever the proportional target
+ * moves, even by a single table step. Where transitions are slow that
+ * costs more than it gains. The cost of a transition is what the driver
+ * reports in cpuinfo.transition_latency, raised to what changing
+ * frequency through __cpufreq_driver_target() actually takes here.
+ *
+ * A change from cur to freq is worth it if the relative frequency change
+ * over the time it will likely hold outweighs transition_cost_factor
+ * times that cost:
+ *
+ *	hold * |freq - cur| / cur > transition_cost_factor * cost
+ *
+ * so the hysteresis band widens by itself on slow platforms and all but
+ * vanishes on fast ones. hold is how long cur has held so far, and at
+ * least one sampling period: a frequency that held long is likely to be
+ * followed by one that does too. A single period would not do, a step
+ * down never changes frequency by more than (max - min) / max, so past
+ * some cost the policy could never leave max. Holding grows the band
+ * back down instead: the larger the change, the sooner it is allowed. No transition follows the previous one sooner
+ * than min_dwell_us or transition_cost_factor * cost, whichever is
+ * longer. Jumps to max for a load over up_threshold bypass both, their
+ * latency benefit is what the threshold is for.
+ */
+static u64 odx_transition_cost_ns(struct cpufreq_policy *policy,
+				  struct od_policy_dbs_info *dbs_info)
+{
+	u64 cost = policy->cpuinfo.transition_latency;
+
+	if (policy->cpuinfo.transition_latency == CPUFREQ_ETERNAL)
+		cost = DEF_TRANSITION_COST_NS;
+
+	return max(cost, dbs_info->transition_cost_ns);
+}
+
+static bool odx_worth_switching(struct cpufreq_policy *policy, unsigned int freq,
+				unsigned int relation)
+{
+	struct policy_dbs_info *policy_dbs = policy->governor_data;
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
+	struct dbs_data *dbs_data = policy_dbs->dbs_data;
+	struct od_dbs_tuners *tuners = dbs_data->tuners;
+	u64 cost, dwell, hold, now = ktime_get_ns();
+	unsigned int delta;
+
+	if (!tuners->transition_cost_factor && !tuners->min_dwell_us)
+		return true;
+
+	/* compare against what the driver would actually be asked for */
+	if (policy->freq_table)
+		freq = policy->freq_table[cpufreq_frequency_table_target(policy, freq, relation)].frequency;
+	if (freq == policy->cur || !policy->cur)
+		return true;
+
+	cost = odx_transition_cost_ns(policy, dbs_info);
+	dwell = max((u64)tuners->min_dwell_us * NSEC_PER_USEC,
+		    tuners->transition_cost_factor * cost);
+	if (now - dbs_info->last_transition_ns < dwell)
+		return false;
+
+	delta = freq > policy->cur ? freq - policy->cur : policy->cur - freq;
+	hold = max((u64)(dbs_info->period_us ?: dbs_data->sampling_rate) *
+		   policy_dbs->rate_mult * NSEC_PER_USEC,
+		   now - dbs_info->last_transition_ns);
+
+	return div_u64(hold * delta, policy->cur) > tuners->transition_cost_factor * cost;
+}
+
+/* __cpufreq_driver_target(), measuring what a real transition costs */
+static void odx_driver_target(struct cpufreq_policy *policy, unsigned int freq,
+			      unsigned int relation)
+{
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy->governor_data);
+	unsigned int old = policy->cur;
+	u64 start = ktime_get_ns(), end;
+
+	__cpufreq_driver_target(policy, freq, relation);
+	if (policy->cur == old)
+		return;
+
+	end = ktime_get_ns();
+	dbs_info->last_transition_ns = end;
+	if (dbs_info->transition_cost_ns)
+		dbs_info->transition_cost_ns = (7 * dbs_info->transition_cost_ns + end - start) / 8;
+	else
+		dbs_info->transition_cost_ns = end - start;
+}
+
+/************************** transition cost end ************************/
+
+/************************** adaptive sampling ************************/
+
+/*
+ * ondemand samples every sampling_rate whether the load moves or not.
+ * With adaptive_sampling set the period follows an EWMA of the load's
+ * variance instead:
+ *
+ *  - over adaptive_stddev, the load is changing and the period drops to
+ *    sampling_rate / adaptive_speedup, to follow it closely;
+ *  - under half of that, or with the cpu idle, nothing is happening and
+ *    the period doubles on every sample, up to adaptive_backoff_max
+ *    times sampling_rate;
+ *  - in between it is sampling_rate.
+ *
+ * A jump in load lands far from the mean and shortens the period on
+ * the sample that sees it, so backing off costs at most one long period
+ * of reaction; low_latency covers that one.
+ *
+ * Backing off goes through rate_mult, as sampling_down_factor does, set
+ * by od_update() while below up_threshold. dbs_update() takes a cpu that
+ * idled over twice sampling_rate * rate_mult for one just woken up and
+ * replays its previous load; with the period in rate_mult that never
+ * happens to a cpu that was sampled on time, however partly idle.
+ */
+static void odx_adapt_period(struct policy_dbs_info *policy_dbs, unsigned int load)
+{
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
+	struct dbs_data *dbs_data = policy_dbs->dbs_data;
+	struct od_dbs_tuners *tuners = dbs_data->tuners;
+	unsigned int rate = dbs_data->sampling_rate, moving, backoff = dbs_info->backoff;
+	int diff = ((int)load << ODX_FP_SHIFT) - dbs_info->load_mean;
+
+	/* weight 1/4 for the new sample, on the mean and the variance */
+	dbs_info->load_mean += diff / 4;
+	dbs_info->load_var = 3 * (dbs_info->load_var +
+				  (unsigned int)(((s64)diff * diff) >> ODX_FP_SHIFT) / 4) / 4;
+
+	dbs_info->period_us = 0;
+	dbs_info->backoff = 1;
+	if (!tuners->adaptive_sampling)
+		return;
+
+	moving = (tuners->adaptive_stddev * tuners->adaptive_stddev) << ODX_FP_SHIFT;
+
+	if ((load < ADAPTIVE_IDLE_LOAD &&
+	     dbs_info->load_mean < (ADAPTIVE_IDLE_LOAD << ODX_FP_SHIFT)) ||
+	    dbs_info->load_var < moving / 4)
+		dbs_info->backoff = min(backoff * 2, tuners->adaptive_backoff_max);
+	else if (dbs_info->load_var > moving)
+		dbs_info->period_us = min(rate, max(rate / tuners->adaptive_speedup,
+						    (unsigned int)MIN_ADAPTIVE_SAMPLING_US));
+}
+
+/************************** adaptive sampling end ************************/
+
 /*
  * Not all CPUs want IO time to be accounted as busy; this depends on how
  * efficient idling at a higher frequency/voltage is.
@@ -114,7 +509,7 @@ static void ondemand_powersave_bias_init(struct cpufreq_policy *policy)
 	dbs_info->freq_lo = 0;
 }
 
-static void dbs_freq_increase(struct cpufreq_policy *policy, unsigned int freq)
+static unsigned int dbs_freq_increase(struct cpufreq_policy *policy, unsigned int freq)
 {
 	struct policy_dbs_info *policy_dbs = policy->governor_data;
 	struct dbs_data *dbs_data = policy_dbs->dbs_data;
@@ -123,10 +518,10 @@ static void dbs_freq_increase(struct cpufreq_policy *policy, unsigned int freq)
 	if (od_tuners->powersave_bias)
 		freq = od_ops.powersave_bias_target(policy, freq, CPUFREQ_RELATION_H);
 	else if (policy->cur == policy->max)
-		return;
+		return 0;
 
-	// printk(KERN_ALERT "%s: freq: %u", __func__, freq);
-	__cpufreq_driver_target(policy, freq, od_tuners->powersave_bias ? CPUFREQ_RELATION_L : CPUFREQ_RELATION_H);
+	odx_driver_target(policy, freq, od_tuners->powersave_bias ? CPUFREQ_RELATION_L : CPUFREQ_RELATION_H);
+	return freq;
 }
 
 /*
@@ -134,7 +529,7 @@ static void dbs_freq_increase(struct cpufreq_policy *policy, unsigned int freq)
  * (default), then we try to increase frequency. Else, we adjust the frequency
  * proportional to load.
  */
-static void od_update(struct cpufreq_policy *policy)
+static void od_update(struct cpufreq_policy *policy, unsigned int burst)
 {
 	struct policy_dbs_info *policy_dbs = policy->governor_data;
 	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
@@ -142,36 +537,67 @@ static void od_update(struct cpufreq_policy *policy)
 	struct od_dbs_tuners *od_tuners = dbs_data->tuners;
 
 	unsigned int load = dbs_update(policy);
+	unsigned int cur = policy->cur, target;
+	unsigned int predicted = odx_predict_load(od_tuners, &dbs_info->predict, load);
 
 	dbs_info->freq_lo = 0;
 
-	/* Check for frequency increase */
-	if (load > dbs_data->up_threshold)
+	/* the window since the last sample dilutes a burst that just began */
+	load = max(load, burst);
+	odx_adapt_period(policy_dbs, load);
+
+	/*
+	 * Check for frequency increase; a load that is already over the
+	 * threshold goes up right away whatever the predictor says
+	 */
+	if (load > dbs_data->up_threshold || predicted > dbs_data->up_threshold)
 	{
 		/* If switching to max speed, apply sampling_down_factor */
 		if (policy->cur < policy->max)
 			policy_dbs->rate_mult = dbs_data->sampling_down_factor;
-		dbs_freq_increase(policy, policy->max);
+		target = dbs_freq_increase(policy, policy->max);
 	}
 	else
 	{
 		/* Calculate the next frequency proportional to load */
 		unsigned int freq_next, min_f, max_f;
+		unsigned int relation = CPUFREQ_RELATION_C;
+		struct odx_efficiency *eff = READ_ONCE(od_tuners->efficiency);
 
 		min_f = policy->cpuinfo.min_freq;
 		max_f = policy->cpuinfo.max_freq;
-		freq_next = min_f + load * (max_f - min_f) / 100;
+		freq_next = min_f + predicted * (max_f - min_f) / 100;
 
-		/* No longer fully busy, reset rate_mult */
-		policy_dbs->rate_mult = 1;
+		/* or the cheapest one that keeps up, never going below it */
+		if (eff)
+		{
+			freq_next = odx_efficiency_target(eff, cur, predicted,
+											  dbs_data->up_threshold) ?: policy->max;
+			relation = CPUFREQ_RELATION_L;
+		}
+
+		/* No longer fully busy, reset rate_mult, or back off, see odx_adapt_period() */
+		policy_dbs->rate_mult = dbs_info->backoff;
 
 		if (od_tuners->powersave_bias)
 		{
 			freq_next = od_ops.powersave_bias_target(policy, freq_next, CPUFREQ_RELATION_L);
 		}
-		printk(KERN_ALERT "%s: cpu: %u freq_next: %u KHz", __func__, policy->cpu, freq_next);
-		__cpufreq_driver_target(policy, freq_next, CPUFREQ_RELATION_C);
+		if (odx_worth_switching(policy, freq_next, relation))
+		{
+			odx_driver_target(policy, freq_next, relation);
+			target = freq_next;
+		}
+		else
+		{
+			/* nor is the freq_lo half of a powersave_bias average */
+			dbs_info->freq_lo = 0;
+			dbs_info->freq_lo_delay_us = 0;
+			target = 0;
+		}
 	}
+
+	odx_account(policy, load, predicted, cur, target);
 }
 
 static unsigned int od_dbs_update(struct cpufreq_policy *policy)
@@ -180,21 +606,23 @@ static unsigned int od_dbs_update(struct cpufreq_policy *policy)
 	struct dbs_data *dbs_data = policy_dbs->dbs_data;
 	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
 	int sample_type = dbs_info->sample_type;
+	unsigned int burst = xchg(&dbs_info->burst_load, 0);
 
 	/* Common NORMAL_SAMPLE setup */
 	dbs_info->sample_type = OD_NORMAL_SAMPLE;
 	/*
 	 * OD_SUB_SAMPLE doesn't make sense if sample_delay_ns is 0, so ignore
-	 * it then.
+	 * it then, or when a burst cut the period short.
 	 */
-	if (sample_type == OD_SUB_SAMPLE && policy_dbs->sample_delay_ns > 0)
+	if (sample_type == OD_SUB_SAMPLE && policy_dbs->sample_delay_ns > 0 && !burst)
 	{
-		__cpufreq_driver_target(policy, dbs_info->freq_lo,
-								CPUFREQ_RELATION_H);
+		trace_ondemandx_sub_sample(policy->cpu, dbs_info->freq_lo,
+					   dbs_info->freq_lo_delay_us);
+		odx_driver_target(policy, dbs_info->freq_lo, CPUFREQ_RELATION_H);
 		return dbs_info->freq_lo_delay_us;
 	}
 
-	od_update(policy);
+	od_update(policy, burst);
 
 	if (dbs_info->freq_lo)
 	{
@@ -203,7 +631,216 @@ static unsigned int od_dbs_update(struct cpufreq_policy *policy)
 		return dbs_info->freq_hi_delay_us;
 	}
 
-	return dbs_data->sampling_rate * policy_dbs->rate_mult;
+	return (dbs_info->period_us ?: dbs_data->sampling_rate) * policy_dbs->rate_mult;
+}
+
+/************************** statistics ************************/
+
+static struct odx_stats *odx_stats_alloc(struct cpufreq_policy *policy)
+{
+	struct cpufreq_frequency_table *table = policy->freq_table;
+	struct odx_stats *stats;
+	unsigned int n = 0;
+
+	if (!table)
+		return NULL;
+	while (table[n].frequency != CPUFREQ_TABLE_END)
+		n++;
+
+	stats = kzalloc(sizeof(*stats) + n * sizeof(*stats->residency_ns) +
+			n * n * sizeof(*stats->transitions), GFP_KERNEL);
+	if (!stats)
+		return NULL;
+
+	stats->nr_freqs = n;
+	stats->residency_ns = (u64 *)(stats + 1);
+	stats->transitions = (unsigned long *)(stats->residency_ns + n);
+	stats->last_index = -1;
+
+	return stats;
+}
+
+static void odx_stats_reset(struct odx_stats *stats)
+{
+	unsigned int n = stats->nr_freqs;
+
+	memset(stats->residency_ns, 0, n * sizeof(*stats->residency_ns));
+	memset(stats->transitions, 0, n * n * sizeof(*stats->transitions));
+	memset(stats->cost_hist, 0, sizeof(stats->cost_hist));
+	stats->last_index = -1;
+}
+
+/* One decision that took from start to end ns; policy->cur is its outcome */
+static void odx_stats_account(struct cpufreq_policy *policy, struct odx_stats *stats,
+			      u64 start, u64 end)
+{
+	int index = cpufreq_frequency_table_get_index(policy, policy->cur);
+
+	stats->cost_hist[min_t(unsigned int, fls64(end - start), ODX_COST_BUCKETS - 1)]++;
+
+	if (stats->last_index >= 0) {
+		stats->residency_ns[stats->last_index] += end - stats->last_ns;
+		if (index >= 0 && index != stats->last_index)
+			stats->transitions[stats->last_index * stats->nr_freqs + index]++;
+	}
+	stats->last_index = index;
+	stats->last_ns = end;
+}
+
+/************************** statistics end ************************/
+
+/************************** scheduler hook ************************/
+
+/*
+ * The common dbs code queues an evaluation from the scheduler's
+ * update_util hook once sample_delay_ns has passed, so a burst that
+ * starts right after a sample waits a whole sampling_rate. ondemandx
+ * installs its own hook in place of that one, doing the same thing,
+ * and with low_latency set also measures each cpu's busy share over
+ * short windows. A window busier than up_threshold queues an
+ * evaluation right away, at most once per low_latency_rate_limit_us, so
+ * the policy reaches max within about a window instead of a period.
+ *
+ * The scheduler doesn't pass utilization to the hook and the functions
+ * that compute it aren't available to modules, so busy time comes from
+ * the nohz idle accounting the load calculation already uses. The hook
+ * can run on another cpu than the one whose runqueue changed, so the
+ * window is always that of the cpu the hook was installed for.
+ */
+struct odx_cpu {
+	struct update_util_data update_util;
+	struct policy_dbs_info *policy_dbs;
+	unsigned int cpu;
+	u64 window_start_ns;
+	u64 window_idle_us;
+	u64 last_burst_ns;
+};
+
+static DEFINE_PER_CPU(struct odx_cpu, odx_cpus);
+
+/* busy percent of c's cpu if its window is over, -1 while it runs */
+static int odx_window_busy(struct odx_cpu *c, struct od_dbs_tuners *tuners, u64 time)
+{
+	u64 elapsed_us = div_u64(time - c->window_start_ns, NSEC_PER_USEC);
+	u64 idle_us;
+	int busy;
+
+	if (c->window_start_ns && elapsed_us < tuners->low_latency_window_us)
+		return -1;
+
+	idle_us = get_cpu_idle_time_us(c->cpu, NULL);
+	if (idle_us == -1ULL)
+		return -1;
+
+	/* first call since start, only open the window */
+	if (!c->window_start_ns) {
+		c->window_start_ns = time;
+		c->window_idle_us = idle_us;
+		return -1;
+	}
+
+	busy = 100 - (int)div64_u64(100 * min(idle_us - c->window_idle_us, elapsed_us), elapsed_us);
+	c->window_start_ns = time;
+	c->window_idle_us = idle_us;
+
+	return busy;
+}
+
+static void odx_update_util(struct update_util_data *data, u64 time, unsigned int flags)
+{
+	struct odx_cpu *c = container_of(data, struct odx_cpu, update_util);
+	struct policy_dbs_info *policy_dbs = c->policy_dbs;
+	struct cpufreq_policy *policy = policy_dbs->policy;
+	struct dbs_data *dbs_data = policy_dbs->dbs_data;
+	struct od_dbs_tuners *tuners = dbs_data->tuners;
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
+	bool burst = false;
+	u64 delta_ns, lst;
+	int busy = -1;
+
+	if (!cpumask_test_cpu(smp_processor_id(), policy->cpus))
+		return;
+
+	if (tuners->low_latency && READ_ONCE(policy->cur) < READ_ONCE(policy->max) &&
+	    (busy = odx_window_busy(c, tuners, time)) > (int)dbs_data->up_threshold &&
+	    time - c->last_burst_ns >= (u64)tuners->low_latency_rate_limit_us * NSEC_PER_USEC)
+		burst = true;
+
+	/* from here on as dbs_update_util_handler() */
+	if (policy_dbs->work_in_progress)
+		return;
+
+	smp_rmb();
+	lst = READ_ONCE(policy_dbs->last_sample_time);
+	delta_ns = time - lst;
+	if (!burst && (s64)delta_ns < policy_dbs->sample_delay_ns)
+		return;
+
+	if (policy_dbs->is_shared) {
+		if (!atomic_add_unless(&policy_dbs->work_count, 1, 1))
+			return;
+
+		if (unlikely(lst != READ_ONCE(policy_dbs->last_sample_time))) {
+			atomic_set(&policy_dbs->work_count, 0);
+			return;
+		}
+	}
+
+	if (burst) {
+		c->last_burst_ns = time;
+		if (busy > READ_ONCE(dbs_info->burst_load))
+			WRITE_ONCE(dbs_info->burst_load, busy);
+	}
+
+	policy_dbs->last_sample_time = time;
+	policy_dbs->work_in_progress = true;
+	irq_work_queue(&policy_dbs->irq_work);
+}
+
+/*
+ * cpufreq_dbs_governor_start() installs the common hook last, so it is
+ * swapped for ours afterwards; cpufreq_dbs_governor_stop() removes
+ * whichever hook is installed and waits for it to finish.
+ */
+static int odx_governor_start(struct cpufreq_policy *policy)
+{
+	struct policy_dbs_info *policy_dbs;
+	unsigned int cpu;
+	int ret;
+
+	ret = cpufreq_dbs_governor_start(policy);
+	if (ret)
+		return ret;
+
+	policy_dbs = policy->governor_data;
+	for_each_cpu(cpu, policy->cpus) {
+		struct odx_cpu *c = per_cpu_ptr(&odx_cpus, cpu);
+
+		c->policy_dbs = policy_dbs;
+		c->cpu = cpu;
+		c->window_start_ns = 0;
+		c->last_burst_ns = 0;
+
+		cpufreq_remove_update_util_hook(cpu);
+		cpufreq_add_update_util_hook(cpu, &c->update_util, odx_update_util);
+	}
+
+	return 0;
+}
+
+/************************** scheduler hook end ************************/
+
+/* od_dbs_update() as the dbs core sees it, timed for the statistics */
+static unsigned int odx_dbs_update(struct cpufreq_policy *policy)
+{
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy->governor_data);
+	u64 start = ktime_get_ns();
+	unsigned int delay_us = od_dbs_update(policy);
+
+	if (dbs_info->stats)
+		odx_stats_account(policy, dbs_info->stats, start, ktime_get_ns());
+
+	return delay_us;
 }
 
 /************************** sysfs interface ************************/
@@ -324,12 +961,297 @@ static ssize_t store_powersave_bias(struct gov_attr_set *attr_set,
 	return count;
 }
 
+/* takes effect from a clean history on every policy */
+static void odx_reset_predictors(struct gov_attr_set *attr_set)
+{
+	struct policy_dbs_info *policy_dbs;
+
+	list_for_each_entry(policy_dbs, &attr_set->policy_list, list)
+	{
+		mutex_lock(&policy_dbs->update_mutex);
+		odx_predict_reset(&to_dbs_info(policy_dbs)->predict);
+		mutex_unlock(&policy_dbs->update_mutex);
+	}
+}
+
+static ssize_t store_predictor(struct gov_attr_set *attr_set,
+							   const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input >= ODX_NR_PREDICTORS)
+		return -EINVAL;
+
+	od_tuners->predictor = input;
+	odx_reset_predictors(attr_set);
+
+	return count;
+}
+
+static ssize_t store_predict_alpha(struct gov_attr_set *attr_set,
+								   const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input < 1 || input > 100)
+		return -EINVAL;
+
+	od_tuners->predict_alpha = input;
+	return count;
+}
+
+static ssize_t store_predict_beta(struct gov_attr_set *attr_set,
+								  const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input > 100)
+		return -EINVAL;
+
+	od_tuners->predict_beta = input;
+	return count;
+}
+
+static ssize_t store_predict_period_max(struct gov_attr_set *attr_set,
+										const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	/* leave at least half the history to compare periods over */
+	if (sscanf(buf, "%u", &input) != 1 || input < MIN_PREDICT_PERIOD ||
+		input > ODX_HISTORY / 2)
+		return -EINVAL;
+
+	od_tuners->predict_period_max = input;
+	return count;
+}
+
+/*
+ * Lines of "<freq kHz> <power mW> <perf>" in increasing frequency, as
+ * measured by running one workload pinned at each frequency (e.g. with
+ * userspacex and rapl stat). perf is its throughput in any unit, as long
+ * as it is the same for every line, and must not drop as frequency rises:
+ * smooth out sweep noise before loading the table. Writing nothing, or
+ * "0", goes back to the linear mapping.
+ */
+static ssize_t store_efficiency_table(struct gov_attr_set *attr_set,
+									  const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	struct odx_efficiency *eff, *old;
+	struct odx_efficiency_entry *e;
+	struct policy_dbs_info *policy_dbs;
+	int n, ret;
+
+	eff = kzalloc(sizeof(*eff), GFP_KERNEL);
+	if (!eff)
+		return -ENOMEM;
+
+	while (eff->nr < ODX_MAX_FREQS) {
+		e = &eff->entries[eff->nr];
+		ret = sscanf(buf, "%u %u %u%n", &e->freq, &e->power, &e->perf, &n);
+		if (ret <= 0 || (ret == 1 && eff->nr == 0 && e->freq == 0))
+			break;
+		if (ret != 3 || !e->freq || !e->perf ||
+			(eff->nr && (e->freq <= eff->entries[eff->nr - 1].freq ||
+				     e->perf < eff->entries[eff->nr - 1].perf))) {
+			kfree(eff);
+			return -EINVAL;
+		}
+		eff->nr++;
+		buf += n;
+	}
+
+	if (eff->nr) {
+		odx_efficiency_mark(eff);
+	} else {
+		kfree(eff);
+		eff = NULL;
+	}
+
+	old = od_tuners->efficiency;
+	WRITE_ONCE(od_tuners->efficiency, eff);
+
+	/* wait out any od_update() still looking at the old table */
+	list_for_each_entry(policy_dbs, &attr_set->policy_list, list)
+	{
+		mutex_lock(&policy_dbs->update_mutex);
+		mutex_unlock(&policy_dbs->update_mutex);
+	}
+	kfree(old);
+
+	return count;
+}
+
+/*
+ * The table as loaded, entries never worth using are marked with skip.
+ * governor_show() takes no lock, update_lock keeps a store from freeing
+ * the table under us.
+ */
+static ssize_t show_efficiency_table(struct gov_attr_set *attr_set, char *buf)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	struct odx_efficiency *eff;
+	struct odx_efficiency_entry *e;
+	ssize_t len = 0;
+	unsigned int i;
+
+	mutex_lock(&attr_set->update_lock);
+	eff = od_tuners->efficiency;
+	for (i = 0; eff && i < eff->nr; i++) {
+		e = &eff->entries[i];
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%u %u %u%s\n",
+				 e->freq, e->power, e->perf, e->skip ? " skip" : "");
+	}
+	mutex_unlock(&attr_set->update_lock);
+
+	return len;
+}
+
+static ssize_t store_low_latency(struct gov_attr_set *attr_set,
+								 const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->low_latency, !!input);
+	return count;
+}
+
+static ssize_t store_low_latency_window_us(struct gov_attr_set *attr_set,
+										   const char *buf, size_t count)
+{
+	struct dbs_data *dbs_data = to_dbs_data(attr_set);
+	struct od_dbs_tuners *od_tuners = dbs_data->tuners;
+	unsigned int input;
+
+	/* a window as long as the sampling rate wins nothing */
+	if (sscanf(buf, "%u", &input) != 1 || input < MIN_LOW_LATENCY_WINDOW_US ||
+		input >= dbs_data->sampling_rate)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->low_latency_window_us, input);
+	return count;
+}
+
+static ssize_t store_low_latency_rate_limit_us(struct gov_attr_set *attr_set,
+											   const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->low_latency_rate_limit_us, input);
+	return count;
+}
+
+static ssize_t store_transition_cost_factor(struct gov_attr_set *attr_set,
+											const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input > MAX_TRANSITION_COST_FACTOR)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->transition_cost_factor, input);
+	return count;
+}
+
+static ssize_t store_min_dwell_us(struct gov_attr_set *attr_set,
+								  const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->min_dwell_us, input);
+	return count;
+}
+
+static ssize_t store_adaptive_sampling(struct gov_attr_set *attr_set,
+									   const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->adaptive_sampling, !!input);
+	return count;
+}
+
+static ssize_t store_adaptive_speedup(struct gov_attr_set *attr_set,
+									  const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input < 1 || input > MAX_ADAPTIVE_SPEEDUP)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->adaptive_speedup, input);
+	return count;
+}
+
+static ssize_t store_adaptive_backoff_max(struct gov_attr_set *attr_set,
+										  const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	if (sscanf(buf, "%u", &input) != 1 || input < 1 || input > MAX_ADAPTIVE_BACKOFF_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->adaptive_backoff_max, input);
+	return count;
+}
+
+static ssize_t store_adaptive_stddev(struct gov_attr_set *attr_set,
+									 const char *buf, size_t count)
+{
+	struct od_dbs_tuners *od_tuners = to_dbs_data(attr_set)->tuners;
+	unsigned int input;
+
+	/* a load in percent deviates by 50 at most */
+	if (sscanf(buf, "%u", &input) != 1 || input < 1 || input > 50)
+		return -EINVAL;
+
+	WRITE_ONCE(od_tuners->adaptive_stddev, input);
+	return count;
+}
+
 gov_show_one_common(sampling_rate);
 gov_show_one_common(up_threshold);
 gov_show_one_common(sampling_down_factor);
 gov_show_one_common(ignore_nice_load);
 gov_show_one_common(io_is_busy);
 gov_show_one(od, powersave_bias);
+gov_show_one(od, predictor);
+gov_show_one(od, predict_alpha);
+gov_show_one(od, predict_beta);
+gov_show_one(od, predict_period_max);
+gov_show_one(od, low_latency);
+gov_show_one(od, low_latency_window_us);
+gov_show_one(od, low_latency_rate_limit_us);
+gov_show_one(od, transition_cost_factor);
+gov_show_one(od, min_dwell_us);
+gov_show_one(od, adaptive_sampling);
+gov_show_one(od, adaptive_speedup);
+gov_show_one(od, adaptive_backoff_max);
+gov_show_one(od, adaptive_stddev);
 
 gov_attr_rw(sampling_rate);
 gov_attr_rw(io_is_busy);
@@ -337,6 +1259,20 @@ gov_attr_rw(up_threshold);
 gov_attr_rw(sampling_down_factor);
 gov_attr_rw(ignore_nice_load);
 gov_attr_rw(powersave_bias);
+gov_attr_rw(predictor);
+gov_attr_rw(predict_alpha);
+gov_attr_rw(predict_beta);
+gov_attr_rw(predict_period_max);
+gov_attr_rw(efficiency_table);
+gov_attr_rw(low_latency);
+gov_attr_rw(low_latency_window_us);
+gov_attr_rw(low_latency_rate_limit_us);
+gov_attr_rw(transition_cost_factor);
+gov_attr_rw(min_dwell_us);
+gov_attr_rw(adaptive_sampling);
+gov_attr_rw(adaptive_speedup);
+gov_attr_rw(adaptive_backoff_max);
+gov_attr_rw(adaptive_stddev);
 
 static struct attribute *od_attributes[] = {
 	&sampling_rate.attr,
@@ -345,10 +1281,215 @@ static struct attribute *od_attributes[] = {
 	&ignore_nice_load.attr,
 	&powersave_bias.attr,
 	&io_is_busy.attr,
+	&predictor.attr,
+	&predict_alpha.attr,
+	&predict_beta.attr,
+	&predict_period_max.attr,
+	&efficiency_table.attr,
+	&low_latency.attr,
+	&low_latency_window_us.attr,
+	&low_latency_rate_limit_us.attr,
+	&transition_cost_factor.attr,
+	&min_dwell_us.attr,
+	&adaptive_sampling.attr,
+	&adaptive_speedup.attr,
+	&adaptive_backoff_max.attr,
+	&adaptive_stddev.attr,
 	NULL};
 
 /************************** sysfs end ************************/
 
+/************************** debugfs interface ************************/
+
+/*
+ * <debugfs>/ondemandx/
+ *	log			last ODX_LOG_ENTRIES decisions made on each cpu
+ *	policy<cpu>/load_hist	decisions per 10% load bucket
+ *	policy<cpu>/freq_hist	requested frequencies per freq_table entry
+ *	policy<cpu>/residency	ms spent at each frequency
+ *	policy<cpu>/transitions	from (rows) -> to (columns) transition counts
+ *	policy<cpu>/cost_hist	ns spent per od_dbs_update(), log2 buckets
+ *	policy<cpu>/reset	write anything to clear the above
+ *	policy<cpu>/transition_cost	reported and measured ns per transition
+ */
+static struct dentry *odx_debugfs_root;
+
+static int odx_log_show(struct seq_file *m, void *unused)
+{
+	struct odx_log *log;
+	struct odx_log_entry *e;
+	unsigned long head, i;
+	int cpu;
+
+	seq_puts(m, "# logcpu time_ns policy load cur target\n");
+	for_each_possible_cpu(cpu) {
+		log = per_cpu_ptr(&odx_log, cpu);
+		head = smp_load_acquire(&log->head);
+		i = head > ODX_LOG_ENTRIES ? head - ODX_LOG_ENTRIES : 0;
+		for (; i < head; i++) {
+			e = &log->entries[i & (ODX_LOG_ENTRIES - 1)];
+			seq_printf(m, "%d %llu %u %u %u %u\n", cpu, e->time_ns,
+				   e->cpu, e->load, e->cur, e->target);
+		}
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_log);
+
+static int odx_load_hist_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	int i;
+
+	for (i = 0; i < ODX_LOAD_BUCKETS - 1; i++)
+		seq_printf(m, "%3d-%-3d %lu\n", i * 10, i * 10 + 9,
+			   READ_ONCE(dbs_info->load_hist[i]));
+	seq_printf(m, "%7d %lu\n", 100, READ_ONCE(dbs_info->load_hist[i]));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_load_hist);
+
+static int odx_freq_hist_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	struct cpufreq_frequency_table *pos, *table = dbs_info->policy_dbs.policy->freq_table;
+	int i;
+
+	if (!table)
+		return 0;
+
+	cpufreq_for_each_valid_entry_idx(pos, table, i)
+		if (i < ODX_MAX_FREQS)
+			seq_printf(m, "%u %lu\n", pos->frequency,
+				   READ_ONCE(dbs_info->freq_hist[i]));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_freq_hist);
+
+static int odx_residency_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	struct odx_stats *stats = dbs_info->stats;
+	struct cpufreq_frequency_table *pos;
+	int i;
+
+	cpufreq_for_each_valid_entry_idx(pos, dbs_info->policy_dbs.policy->freq_table, i)
+		seq_printf(m, "%u %llu\n", pos->frequency,
+			   div_u64(READ_ONCE(stats->residency_ns[i]), NSEC_PER_MSEC));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_residency);
+
+static int odx_transitions_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	struct odx_stats *stats = dbs_info->stats;
+	struct cpufreq_frequency_table *from, *to, *table = dbs_info->policy_dbs.policy->freq_table;
+	int i, j;
+
+	seq_puts(m, "   From  :    To\n         :");
+	cpufreq_for_each_valid_entry(to, table)
+		seq_printf(m, " %9u", to->frequency);
+	seq_puts(m, "\n");
+
+	cpufreq_for_each_valid_entry_idx(from, table, i) {
+		seq_printf(m, "%9u:", from->frequency);
+		cpufreq_for_each_valid_entry_idx(to, table, j)
+			seq_printf(m, " %9lu",
+				   READ_ONCE(stats->transitions[i * stats->nr_freqs + j]));
+		seq_puts(m, "\n");
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_transitions);
+
+static int odx_cost_hist_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	struct odx_stats *stats = dbs_info->stats;
+	int b;
+
+	seq_printf(m, "%llu-%llu %lu\n", 0ULL, 0ULL, READ_ONCE(stats->cost_hist[0]));
+	for (b = 1; b < ODX_COST_BUCKETS - 1; b++)
+		seq_printf(m, "%llu-%llu %lu\n", 1ULL << (b - 1), (1ULL << b) - 1,
+			   READ_ONCE(stats->cost_hist[b]));
+	seq_printf(m, "%llu- %lu\n", 1ULL << (b - 1), READ_ONCE(stats->cost_hist[b]));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_cost_hist);
+
+static int odx_transition_cost_show(struct seq_file *m, void *unused)
+{
+	struct od_policy_dbs_info *dbs_info = m->private;
+	struct cpufreq_policy *policy = dbs_info->policy_dbs.policy;
+
+	seq_printf(m, "reported %u\nmeasured %llu\nused %llu\n",
+		   policy->cpuinfo.transition_latency,
+		   READ_ONCE(dbs_info->transition_cost_ns),
+		   odx_transition_cost_ns(policy, dbs_info));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(odx_transition_cost);
+
+static ssize_t odx_reset_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct od_policy_dbs_info *dbs_info = file->private_data;
+
+	mutex_lock(&dbs_info->policy_dbs.update_mutex);
+	memset(dbs_info->load_hist, 0, sizeof(dbs_info->load_hist));
+	memset(dbs_info->freq_hist, 0, sizeof(dbs_info->freq_hist));
+	if (dbs_info->stats)
+		odx_stats_reset(dbs_info->stats);
+	mutex_unlock(&dbs_info->policy_dbs.update_mutex);
+
+	return count;
+}
+
+static const struct file_operations odx_reset_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = odx_reset_write,
+	.llseek = noop_llseek,
+};
+
+static void odx_debugfs_add_policy(struct cpufreq_policy *policy)
+{
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy->governor_data);
+	char name[16];
+
+	if (dbs_info->debugfs)
+		return;
+
+	snprintf(name, sizeof(name), "policy%u", policy->cpu);
+	dbs_info->debugfs = debugfs_create_dir(name, odx_debugfs_root);
+	debugfs_create_file("load_hist", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_load_hist_fops);
+	debugfs_create_file("freq_hist", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_freq_hist_fops);
+	debugfs_create_file("reset", 0200, dbs_info->debugfs, dbs_info,
+			    &odx_reset_fops);
+	debugfs_create_file("transition_cost", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_transition_cost_fops);
+	if (!dbs_info->stats)
+		return;
+	debugfs_create_file("residency", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_residency_fops);
+	debugfs_create_file("transitions", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_transitions_fops);
+	debugfs_create_file("cost_hist", 0444, dbs_info->debugfs, dbs_info,
+			    &odx_cost_hist_fops);
+}
+
+/************************** debugfs end ************************/
+
 static struct policy_dbs_info *od_alloc(void)
 {
 	struct od_policy_dbs_info *dbs_info;
@@ -359,7 +1500,11 @@ static struct policy_dbs_info *od_alloc(void)
 
 static void od_free(struct policy_dbs_info *policy_dbs)
 {
-	kfree(to_dbs_info(policy_dbs));
+	struct od_policy_dbs_info *dbs_info = to_dbs_info(policy_dbs);
+
+	debugfs_remove_recursive(dbs_info->debugfs);
+	kfree(dbs_info->stats);
+	kfree(dbs_info);
 }
 
 static int od_init(struct dbs_data *dbs_data)
@@ -388,6 +1533,19 @@ static int od_init(struct dbs_data *dbs_data)
 	dbs_data->sampling_down_factor = DEF_SAMPLING_DOWN_FACTOR;
 	dbs_data->ignore_nice_load = 0;
 	tuners->powersave_bias = default_powersave_bias;
+	tuners->predictor = ODX_PREDICT_NONE;
+	tuners->predict_alpha = DEF_PREDICT_ALPHA;
+	tuners->predict_beta = DEF_PREDICT_BETA;
+	tuners->predict_period_max = DEF_PREDICT_PERIOD_MAX;
+	tuners->low_latency = 0;
+	tuners->low_latency_window_us = DEF_LOW_LATENCY_WINDOW_US;
+	tuners->low_latency_rate_limit_us = DEF_LOW_LATENCY_RATE_LIMIT_US;
+	tuners->transition_cost_factor = DEF_TRANSITION_COST_FACTOR;
+	tuners->min_dwell_us = 0;
+	tuners->adaptive_sampling = 0;
+	tuners->adaptive_speedup = DEF_ADAPTIVE_SPEEDUP;
+	tuners->adaptive_backoff_max = DEF_ADAPTIVE_BACKOFF_MAX;
+	tuners->adaptive_stddev = DEF_ADAPTIVE_STDDEV;
 	dbs_data->io_is_busy = should_io_be_busy();
 
 	dbs_data->tuners = tuners;
@@ -396,7 +1554,10 @@ static int od_init(struct dbs_data *dbs_data)
 
 static void od_exit(struct dbs_data *dbs_data)
 {
-	kfree(dbs_data->tuners);
+	struct od_dbs_tuners *tuners = dbs_data->tuners;
+
+	kfree(tuners->efficiency);
+	kfree(tuners);
 }
 
 static void od_start(struct cpufreq_policy *policy)
@@ -405,12 +1566,26 @@ static void od_start(struct cpufreq_policy *policy)
 
 	dbs_info->sample_type = OD_NORMAL_SAMPLE;
 	ondemand_powersave_bias_init(policy);
+	odx_predict_reset(&dbs_info->predict);
+	dbs_info->burst_load = 0;
+	dbs_info->period_us = 0;
+	dbs_info->backoff = 1;
+	dbs_info->load_mean = 0;
+	dbs_info->load_var = 0;
+
+	/* a restart keeps the numbers but not the open residency interval */
+	if (!dbs_info->stats)
+		dbs_info->stats = odx_stats_alloc(policy);
+	if (dbs_info->stats)
+		dbs_info->stats->last_index = -1;
+
+	odx_debugfs_add_policy(policy);
 }
 
 static struct dbs_governor od_dbs_gov = {
 	.gov = CPUFREQ_DBS_GOVERNOR_INITIALIZER(ONDEMANDX),
 	.kobj_type = {.default_attrs = od_attributes},
-	.gov_dbs_update = od_dbs_update,
+	.gov_dbs_update = odx_dbs_update,
 	.alloc = od_alloc,
 	.free = od_free,
 	.init = od_init,
@@ -478,6 +1653,7 @@ static struct od_ops od_ops = {
 static int __init cpufreq_ondemandx_dbs_init(void)
 {
 	unsigned int n_cpu, i;
+	int ret;
 	n_cpu = 0;
 	for_each_online_cpu(i)
 	{
@@ -486,13 +1662,24 @@ static int __init cpufreq_ondemandx_dbs_init(void)
 	printk(KERN_INFO "%s governor __init - online CPUs : %u", ONDEMANDX, n_cpu);
 	printk(KERN_INFO "%s governor INSTALLED successfully!\n", ONDEMANDX);
 
-	return cpufreq_register_governor(&CPU_FREQ_GOV_ONDEMANDX);
+	/* swaps the common scheduler hook for odx_update_util() */
+	CPU_FREQ_GOV_ONDEMANDX.start = odx_governor_start;
+
+	odx_debugfs_root = debugfs_create_dir(ONDEMANDX, NULL);
+	debugfs_create_file("log", 0444, odx_debugfs_root, NULL, &odx_log_fops);
+
+	ret = cpufreq_register_governor(&CPU_FREQ_GOV_ONDEMANDX);
+	if (ret)
+		debugfs_remove_recursive(odx_debugfs_root);
+
+	return ret;
 }
 
 static void __exit cpufreq_ondemandx_dbs_exit(void)
 {
 	printk(KERN_INFO "%s governor UNINSTALLED successfully!\n", ONDEMANDX);
 	cpufreq_unregister_governor(&CPU_FREQ_GOV_ONDEMANDX);
+	debugfs_remove_recursive(odx_debugfs_root);
 }
 
 MODULE_AUTHOR("Dipanzan Islam <dipanzan@live.com>");
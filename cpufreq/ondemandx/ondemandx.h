@@ -8,12 +8,73 @@
 
 #include "cpufreq_governor.h"
 
+/* load histogram buckets are 10% wide, the last one is 100% only */
+#define ODX_LOAD_BUCKETS	11
+/* frequency table entries with their own histogram bucket */
+#define ODX_MAX_FREQS		64
+/* od_dbs_update() cost histogram, bucket b holds [2^(b-1), 2^b) ns */
+#define ODX_COST_BUCKETS	24
+/* samples of load history kept for the periodic predictor, power of 2 */
+#define ODX_HISTORY		64
+/* fixed point shift of the predictor's level and trend */
+#define ODX_FP_SHIFT		10
+
+enum odx_predictor {
+	ODX_PREDICT_NONE,	/* the last sample's load, as ondemand */
+	ODX_PREDICT_EWMA,
+	ODX_PREDICT_HOLT,	/* EWMA plus a trend term */
+	ODX_PREDICT_PERIODIC,	/* repeats the best matching period, else Holt */
+	ODX_NR_PREDICTORS,
+};
+
+/* load history of a policy, load is the busiest cpu's as in dbs_update() */
+struct odx_predict {
+	int level;	/* smoothed load << ODX_FP_SHIFT */
+	int trend;	/* per sample, << ODX_FP_SHIFT */
+	unsigned int nr_samples;
+	unsigned int history[ODX_HISTORY];
+};
+
+/*
+ * Per-policy behaviour over time, indexed like policy->freq_table. Only
+ * changed from od_dbs_update(), under update_mutex, so time spent at a
+ * frequency set from outside the governor counts towards the frequency
+ * of the last decision until the next one.
+ */
+struct odx_stats {
+	unsigned int nr_freqs;		/* freq_table entries, valid or not */
+	int last_index;			/* of policy->cur after the last decision, -1 if none */
+	u64 last_ns;
+	u64 *residency_ns;		/* [nr_freqs] */
+	unsigned long *transitions;	/* [from * nr_freqs + to] */
+	unsigned long cost_hist[ODX_COST_BUCKETS];
+};
+
 struct od_policy_dbs_info {
 	struct policy_dbs_info policy_dbs;
 	unsigned int freq_lo;
 	unsigned int freq_lo_delay_us;
 	unsigned int freq_hi_delay_us;
 	unsigned int sample_type:1;
+	struct odx_predict predict;
+	/* busy percent of a burst the scheduler hook saw, 0 if none pending */
+	unsigned int burst_load;
+
+	/* updated under update_mutex, read locklessly through debugfs */
+	struct dentry *debugfs;
+	unsigned long load_hist[ODX_LOAD_BUCKETS];
+	unsigned long freq_hist[ODX_MAX_FREQS]; /* by freq_table index */
+	struct odx_stats *stats;	/* NULL without a freq_table */
+
+	/* see odx_worth_switching() */
+	u64 last_transition_ns;
+	u64 transition_cost_ns;		/* measured, EWMA */
+
+	/* see odx_adapt_period() */
+	unsigned int period_us;		/* next sampling period, 0 for sampling_rate */
+	unsigned int backoff;		/* rate_mult below up_threshold */
+	int load_mean;			/* EWMA, << ODX_FP_SHIFT */
+	unsigned int load_var;		/* EWMA, percent^2 << ODX_FP_SHIFT */
 };
 
 static inline struct od_policy_dbs_info *to_dbs_info(struct policy_dbs_info *policy_dbs)
@@ -21,8 +82,38 @@ static inline struct od_policy_dbs_info *to_dbs_info(struct policy_dbs_info *pol
 	return container_of(policy_dbs, struct od_policy_dbs_info, policy_dbs);
 }
 
+/*
+ * Measured power and performance per frequency, see store_efficiency_table().
+ * Read by od_update() under update_mutex, replaced as a whole.
+ */
+struct odx_efficiency_entry {
+	unsigned int freq;	/* kHz */
+	unsigned int power;	/* mW running the sweep's workload */
+	unsigned int perf;	/* its throughput, any unit */
+	bool skip;		/* another entry does more work for less energy */
+};
+
+struct odx_efficiency {
+	unsigned int nr;
+	struct odx_efficiency_entry entries[ODX_MAX_FREQS];
+};
+
 struct od_dbs_tuners {
 	unsigned int powersave_bias;
+	unsigned int predictor;		/* enum odx_predictor */
+	unsigned int predict_alpha;	/* EWMA/Holt level weight, percent */
+	unsigned int predict_beta;	/* Holt trend weight, percent */
+	unsigned int predict_period_max; /* longest period searched, samples */
+	struct odx_efficiency *efficiency; /* NULL maps load linearly */
+	unsigned int low_latency;	/* evaluate on bursts, not only per sample */
+	unsigned int low_latency_window_us;	/* shortest window a burst is measured over */
+	unsigned int low_latency_rate_limit_us;	/* least time between burst evaluations */
+	unsigned int transition_cost_factor;	/* benefit needed per unit of cost, 0 = off */
+	unsigned int min_dwell_us;	/* least time between transitions */
+	unsigned int adaptive_sampling;	/* vary the period with the load */
+	unsigned int adaptive_speedup;	/* sampling_rate divisor while load moves */
+	unsigned int adaptive_backoff_max; /* sampling_rate multiple while it holds still */
+	unsigned int adaptive_stddev;	/* load std deviation that counts as moving, percent */
 };
 
 static void print_freq_table(struct cpufreq_policy *policy)
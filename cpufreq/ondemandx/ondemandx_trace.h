@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints for the ondemandx governor, under events/ondemandx/ in
+ * tracefs. Disabled they cost a static branch per decision.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ondemandx
+
+#if !defined(_ONDEMANDX_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _ONDEMANDX_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * one per od_update(), predicted is the load the frequency was sized for,
+ * target is 0 if the frequency was left alone
+ */
+TRACE_EVENT(ondemandx_update,
+
+	TP_PROTO(unsigned int cpu, unsigned int load, unsigned int predicted,
+		 unsigned int cur, unsigned int target),
+
+	TP_ARGS(cpu, load, predicted, cur, target),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu)
+		__field(unsigned int, load)
+		__field(unsigned int, predicted)
+		__field(unsigned int, cur)
+		__field(unsigned int, target)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->load = load;
+		__entry->predicted = predicted;
+		__entry->cur = cur;
+		__entry->target = target;
+	),
+
+	TP_printk("cpu=%u load=%u predicted=%u cur=%u target=%u",
+		  __entry->cpu, __entry->load, __entry->predicted,
+		  __entry->cur, __entry->target)
+);
+
+/* powersave_bias stepping down to freq_lo for the rest of the period */
+TRACE_EVENT(ondemandx_sub_sample,
+
+	TP_PROTO(unsigned int cpu, unsigned int freq_lo, unsigned int delay_us),
+
+	TP_ARGS(cpu, freq_lo, delay_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned int, cpu)
+		__field(unsigned int, freq_lo)
+		__field(unsigned int, delay_us)
+	),
+
+	TP_fast_assign(
+		__entry->cpu = cpu;
+		__entry->freq_lo = freq_lo;
+		__entry->delay_us = delay_us;
+	),
+
+	TP_printk("cpu=%u freq_lo=%u delay_us=%u",
+		  __entry->cpu, __entry->freq_lo, __entry->delay_us)
+);
+
+#endif /* _ONDEMANDX_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ondemandx_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,202 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * The cpufreq core as the governors see it. The frequency table helpers
+ * behave like the kernel's; __cpufreq_driver_target() is the
+ * simulator's driver, in sim.c.
+ */
+
+#ifndef _SIM_LINUX_CPUFREQ_H
+#define _SIM_LINUX_CPUFREQ_H
+
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+
+#define CPUFREQ_ETERNAL			(-1)
+#define CPUFREQ_RELATION_L		0 /* lowest frequency at or above target */
+#define CPUFREQ_RELATION_H		1 /* highest frequency below or at target */
+#define CPUFREQ_RELATION_C		2 /* closest frequency to target */
+#define CPUFREQ_ENTRY_INVALID		~0u
+#define CPUFREQ_TABLE_END		~1u
+#define CPUFREQ_GOV_DYNAMIC_SWITCHING	BIT(0)
+
+#define LATENCY_MULTIPLIER		1000
+/* older kernels, as dvfs was written for */
+#define MIN_SAMPLING_RATE_RATIO		2
+#define TRANSITION_LATENCY_LIMIT	(10 * 1000 * 1000)
+
+struct cpufreq_cpuinfo {
+	unsigned int max_freq;
+	unsigned int min_freq;
+	unsigned int transition_latency; /* ns */
+};
+
+struct cpufreq_frequency_table {
+	unsigned int flags;
+	unsigned int driver_data;
+	unsigned int frequency; /* kHz */
+};
+
+struct cpufreq_governor;
+
+struct cpufreq_policy {
+	cpumask_var_t cpus;
+	unsigned int cpu;
+	struct cpufreq_cpuinfo cpuinfo;
+	unsigned int min;
+	unsigned int max;
+	unsigned int cur;
+	struct cpufreq_governor *governor;
+	void *governor_data;
+	struct cpufreq_frequency_table *freq_table;
+};
+
+static inline bool policy_is_shared(struct cpufreq_policy *policy)
+{
+	return cpumask_weight(policy->cpus) > 1;
+}
+
+struct attribute {
+	const char *name;
+	umode_t mode;
+};
+
+struct kobj_type {
+	struct attribute **default_attrs;
+};
+
+struct gov_attr_set {
+	struct list_head policy_list;
+	struct mutex update_lock;
+	int usage_count;
+};
+
+struct governor_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct gov_attr_set *attr_set, char *buf);
+	ssize_t (*store)(struct gov_attr_set *attr_set, const char *buf,
+			 size_t count);
+};
+
+#define __ATTR(_name, _mode, _show, _store) {				\
+	.attr = {.name = __stringify(_name), .mode = _mode},		\
+	.show = _show,							\
+	.store = _store,						\
+}
+
+struct cpufreq_governor {
+	char name[16];
+	int (*init)(struct cpufreq_policy *policy);
+	void (*exit)(struct cpufreq_policy *policy);
+	int (*start)(struct cpufreq_policy *policy);
+	void (*stop)(struct cpufreq_policy *policy);
+	void (*limits)(struct cpufreq_policy *policy);
+	struct module *owner;
+	unsigned int flags;
+	unsigned int max_transition_latency; /* older kernels */
+};
+
+int cpufreq_register_governor(struct cpufreq_governor *governor);
+void cpufreq_unregister_governor(struct cpufreq_governor *governor);
+struct cpufreq_policy *cpufreq_cpu_get_raw(unsigned int cpu);
+int __cpufreq_driver_target(struct cpufreq_policy *policy,
+			    unsigned int target_freq, unsigned int relation);
+
+#define cpufreq_for_each_entry_idx(pos, table, idx)			\
+	for (pos = table, idx = 0; pos->frequency != CPUFREQ_TABLE_END;	\
+	     pos++, idx++)
+
+#define cpufreq_for_each_valid_entry_idx(pos, table, idx)		\
+	cpufreq_for_each_entry_idx(pos, table, idx)			\
+		if (pos->frequency == CPUFREQ_ENTRY_INVALID)		\
+			continue;					\
+		else
+
+#define cpufreq_for_each_valid_entry(pos, table)			\
+	for (pos = table; pos->frequency != CPUFREQ_TABLE_END; pos++)	\
+		if (pos->frequency == CPUFREQ_ENTRY_INVALID)		\
+			continue;					\
+		else
+
+/*
+ * The table may be in any order, entries outside policy->min..max are
+ * never picked.
+ */
+static inline int cpufreq_table_find_index(struct cpufreq_policy *policy,
+					   unsigned int target_freq,
+					   unsigned int relation)
+{
+	struct cpufreq_frequency_table *pos;
+	unsigned int freq, best_freq = 0;
+	int idx, best = -1;
+
+	cpufreq_for_each_valid_entry_idx(pos, policy->freq_table, idx) {
+		freq = pos->frequency;
+		if (freq < policy->min || freq > policy->max)
+			continue;
+		if (best < 0)
+			goto take;
+
+		switch (relation) {
+		case CPUFREQ_RELATION_L:
+			/* the lowest at or above, else the highest below */
+			if (freq >= target_freq ?
+			    best_freq < target_freq || freq < best_freq :
+			    best_freq < target_freq && freq > best_freq)
+				goto take;
+			break;
+		case CPUFREQ_RELATION_H:
+			/* the highest at or below, else the lowest above */
+			if (freq <= target_freq ?
+			    best_freq > target_freq || freq > best_freq :
+			    best_freq > target_freq && freq < best_freq)
+				goto take;
+			break;
+		default:
+			if (abs((int)(freq - target_freq)) < abs((int)(best_freq - target_freq)))
+				goto take;
+			break;
+		}
+		continue;
+take:
+		best = idx;
+		best_freq = freq;
+	}
+
+	return best < 0 ? 0 : best;
+}
+
+static inline int cpufreq_table_find_index_l(struct cpufreq_policy *policy,
+					     unsigned int target_freq)
+{
+	return cpufreq_table_find_index(policy, target_freq, CPUFREQ_RELATION_L);
+}
+
+static inline int cpufreq_table_find_index_h(struct cpufreq_policy *policy,
+					     unsigned int target_freq)
+{
+	return cpufreq_table_find_index(policy, target_freq, CPUFREQ_RELATION_H);
+}
+
+static inline int cpufreq_frequency_table_target(struct cpufreq_policy *policy,
+						 unsigned int target_freq,
+						 unsigned int relation)
+{
+	target_freq = clamp_val(target_freq, policy->min, policy->max);
+
+	return cpufreq_table_find_index(policy, target_freq, relation);
+}
+
+static inline int cpufreq_frequency_table_get_index(struct cpufreq_policy *policy,
+						    unsigned int freq)
+{
+	struct cpufreq_frequency_table *pos;
+	int idx;
+
+	cpufreq_for_each_valid_entry_idx(pos, policy->freq_table, idx)
+		if (pos->frequency == freq)
+			return idx;
+
+	return -EINVAL;
+}
+
+#endif
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* debugfs is not there; creating a file succeeds and does nothing. */
+
+#ifndef _SIM_LINUX_DEBUGFS_H
+#define _SIM_LINUX_DEBUGFS_H
+
+#include <linux/fs.h>
+
+struct dentry;
+
+static inline struct dentry *debugfs_create_dir(const char *name,
+						struct dentry *parent)
+{
+	return NULL;
+}
+
+static inline struct dentry *debugfs_create_file(const char *name, umode_t mode,
+						 struct dentry *parent, void *data,
+						 const struct file_operations *fops)
+{
+	return NULL;
+}
+
+static inline void debugfs_remove_recursive(struct dentry *dentry)
+{
+}
+
+#endif
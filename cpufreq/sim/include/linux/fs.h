@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef _SIM_LINUX_FS_H
+#define _SIM_LINUX_FS_H
+
+#include <linux/kernel.h>
+
+struct inode {
+	void *i_private;
+};
+
+struct file {
+	void *private_data;
+};
+
+struct file_operations {
+	struct module *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char __user *buf, size_t count, loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char __user *buf, size_t count,
+			 loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t offset, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+};
+
+static inline int simple_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static inline loff_t noop_llseek(struct file *file, loff_t offset, int whence)
+{
+	return offset;
+}
+
+#endif
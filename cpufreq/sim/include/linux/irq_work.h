@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* irq_work runs right away, on the caller's stack. */
+
+#ifndef _SIM_LINUX_IRQ_WORK_H
+#define _SIM_LINUX_IRQ_WORK_H
+
+#include <linux/kernel.h>
+#include <linux/workqueue.h>
+
+struct irq_work {
+	void (*func)(struct irq_work *work);
+};
+
+#define init_irq_work(w, f)	((w)->func = (f))
+
+static inline bool irq_work_queue(struct irq_work *work)
+{
+	work->func(work);
+	return true;
+}
+
+#endif
@@ -0,0 +1,261 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * The part of the kernel the governors use, for building them in
+ * userspace under the simulator. The other headers under include/linux
+ * only include this one and add what their kernel namesake declares.
+ *
+ * Everything runs on one thread, driven by sim.c: there is no
+ * concurrency, so locks, barriers and irq masking reduce to nothing and
+ * "this cpu" is whichever cpu the simulator is stepping (sim_cpu).
+ */
+
+#ifndef _SIM_LINUX_KERNEL_H
+#define _SIM_LINUX_KERNEL_H
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef unsigned long long u64;
+typedef long long s64;
+typedef unsigned int __u32;
+typedef unsigned long long __u64;
+typedef long __kernel_long_t;
+typedef unsigned short umode_t;
+
+struct module;
+#define THIS_MODULE ((struct module *)0)
+
+#define __init
+#define __exit
+#define __user
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define __stringify_1(x)	#x
+#define __stringify(x)		__stringify_1(x)
+#define BIT(nr)			(1UL << (nr))
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define min(x, y) ({ typeof(x) _x = (x); typeof(y) _y = (y); _x < _y ? _x : _y; })
+#define max(x, y) ({ typeof(x) _x = (x); typeof(y) _y = (y); _x > _y ? _x : _y; })
+#define min_t(type, x, y) ({ type _x = (x); type _y = (y); _x < _y ? _x : _y; })
+#define max_t(type, x, y) ({ type _x = (x); type _y = (y); _x > _y ? _x : _y; })
+#define clamp(val, lo, hi) min(max(val, lo), hi)
+#define clamp_val(val, lo, hi) min_t(typeof(val), max_t(typeof(val), val, lo), hi)
+
+#define NSEC_PER_USEC	1000L
+#define NSEC_PER_MSEC	1000000L
+#define NSEC_PER_SEC	1000000000L
+#define USEC_PER_SEC	1000000L
+#define HZ		250
+#define TICK_NSEC	(NSEC_PER_SEC / HZ)
+#define PAGE_SIZE	4096UL
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline u64 div64_u64(u64 dividend, u64 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline int fls64(u64 x)
+{
+	return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+/* no other thread to race with */
+#define READ_ONCE(x)		(*(volatile typeof(x) *)&(x))
+#define WRITE_ONCE(x, val)	(*(volatile typeof(x) *)&(x) = (val))
+#define smp_rmb()		__sync_synchronize()
+#define smp_wmb()		__sync_synchronize()
+#define smp_mb()		__sync_synchronize()
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define xchg(p, v)		__atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+
+#define local_irq_save(flags)		((flags) = 0)
+#define local_irq_restore(flags)	((void)(flags))
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+static inline void atomic_set(atomic_t *v, int i)
+{
+	v->counter = i;
+}
+
+static inline int atomic_read(const atomic_t *v)
+{
+	return v->counter;
+}
+
+static inline bool atomic_add_unless(atomic_t *v, int a, int u)
+{
+	if (v->counter == u)
+		return false;
+	v->counter += a;
+	return true;
+}
+
+struct mutex {
+	int locked;
+};
+
+#define mutex_init(m)		((m)->locked = 0)
+#define mutex_destroy(m)	((void)(m))
+#define mutex_lock(m)		((m)->locked++)
+#define mutex_unlock(m)		((m)->locked--)
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void list_add_tail(struct list_head *new, struct list_head *head)
+{
+	new->prev = head->prev;
+	new->next = head;
+	head->prev->next = new;
+	head->prev = new;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+}
+
+static inline bool list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, typeof(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_entry(pos->member.next, typeof(*pos), member))
+
+/* cpus */
+#define NR_CPUS		64
+#define nr_cpu_ids	NR_CPUS
+
+struct cpumask {
+	unsigned long long bits;
+};
+
+typedef struct cpumask cpumask_t;
+typedef struct cpumask cpumask_var_t[1];
+
+static inline void cpumask_clear(struct cpumask *m)
+{
+	m->bits = 0;
+}
+
+static inline void cpumask_set_cpu(unsigned int cpu, struct cpumask *m)
+{
+	m->bits |= 1ULL << cpu;
+}
+
+static inline bool cpumask_test_cpu(unsigned int cpu, const struct cpumask *m)
+{
+	return m->bits & (1ULL << cpu);
+}
+
+static inline void cpumask_or(struct cpumask *dst, const struct cpumask *a,
+			      const struct cpumask *b)
+{
+	dst->bits = a->bits | b->bits;
+}
+
+static inline unsigned int cpumask_weight(const struct cpumask *m)
+{
+	return __builtin_popcountll(m->bits);
+}
+
+#define for_each_cpu(cpu, mask)					\
+	for ((cpu) = 0; (cpu) < NR_CPUS; (cpu)++)		\
+		if (!cpumask_test_cpu(cpu, mask))		\
+			;					\
+		else
+
+extern struct cpumask sim_online_mask;
+extern unsigned int sim_cpu;
+
+#define cpu_online_mask			(&sim_online_mask)
+#define for_each_online_cpu(cpu)	for_each_cpu(cpu, cpu_online_mask)
+#define for_each_possible_cpu(cpu)	for ((cpu) = 0; (cpu) < NR_CPUS; (cpu)++)
+#define smp_processor_id()		sim_cpu
+#define get_cpu()			smp_processor_id()
+#define put_cpu()			do { } while (0)
+#define cpus_read_lock()		do { } while (0)
+#define cpus_read_unlock()		do { } while (0)
+#define get_online_cpus()		do { } while (0)
+#define put_online_cpus()		do { } while (0)
+
+/* per-cpu variables are arrays indexed by cpu */
+#define DEFINE_PER_CPU(type, name)	typeof(type) name[NR_CPUS]
+#define per_cpu_ptr(ptr, cpu)		(&(*(ptr))[cpu])
+#define per_cpu(var, cpu)		((var)[cpu])
+#define this_cpu_ptr(ptr)		per_cpu_ptr(ptr, smp_processor_id())
+
+/* memory */
+#define GFP_KERNEL	0
+
+static inline void *kzalloc(size_t size, int flags)
+{
+	return calloc(1, size);
+}
+
+static inline void kfree(const void *p)
+{
+	free((void *)p);
+}
+
+/* printing, printk() goes to stderr with sim -k */
+#define KERN_ALERT	"\0011"
+#define KERN_ERR	"\0013"
+#define KERN_WARNING	"\0014"
+#define KERN_INFO	"\0016"
+#define KERN_DEBUG	"\0017"
+
+int printk(const char *fmt, ...);
+
+static inline int scnprintf(char *buf, size_t size, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (!size)
+		return 0;
+	va_start(args, fmt);
+	n = vsnprintf(buf, size, fmt, args);
+	va_end(args);
+
+	return n < (int)size ? n : (int)size - 1;
+}
+
+/* time is the simulator's */
+u64 ktime_get_ns(void);
+
+#endif
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Memory is reported half used. */
+
+#ifndef _SIM_LINUX_MM_H
+#define _SIM_LINUX_MM_H
+
+#include <linux/kernel.h>
+
+struct sysinfo {
+	unsigned long totalram;
+	unsigned long freeram;
+	unsigned int mem_unit;
+};
+
+static inline void si_meminfo(struct sysinfo *val)
+{
+	val->totalram = 2;
+	val->freeram = 1;
+	val->mem_unit = PAGE_SIZE;
+}
+
+#endif
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* sim_<governor>.c calls the module's init and exit functions itself. */
+
+#ifndef _SIM_LINUX_MODULE_H
+#define _SIM_LINUX_MODULE_H
+
+#include <linux/kernel.h>
+
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define EXPORT_SYMBOL_GPL(sym)
+#define module_init(fn)
+#define module_exit(fn)
+
+#endif
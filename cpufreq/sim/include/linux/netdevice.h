@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* No network devices, so no traffic. */
+
+#ifndef _SIM_LINUX_NETDEVICE_H
+#define _SIM_LINUX_NETDEVICE_H
+
+#include <linux/kernel.h>
+
+struct net;
+struct net_device;
+
+struct rtnl_link_stats64 {
+	__u64 rx_bytes;
+	__u64 tx_bytes;
+};
+
+#define init_net		(*(struct net *)NULL)
+#define dev_base_lock		(*(int *)NULL)
+#define read_lock(lock)		((void)(lock))
+#define read_unlock(lock)	((void)(lock))
+
+static inline struct net_device *first_net_device(struct net *net)
+{
+	return NULL;
+}
+
+static inline struct net_device *next_net_device(struct net_device *dev)
+{
+	return NULL;
+}
+
+static inline struct rtnl_link_stats64 *dev_get_stats(struct net_device *dev,
+						      struct rtnl_link_stats64 *storage)
+{
+	memset(storage, 0, sizeof(*storage));
+	return storage;
+}
+
+#endif
@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* The scheduler's utilization hook, called by sim.c on every tick. */
+
+#ifndef _SIM_LINUX_SCHED_CPUFREQ_H
+#define _SIM_LINUX_SCHED_CPUFREQ_H
+
+#include <linux/kernel.h>
+
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time, unsigned int flags);
+};
+
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+				  void (*func)(struct update_util_data *data, u64 time,
+					       unsigned int flags));
+void cpufreq_remove_update_util_hook(int cpu);
+
+#endif
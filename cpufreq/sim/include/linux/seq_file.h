@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Nothing reads debugfs under the simulator; output is dropped. */
+
+#ifndef _SIM_LINUX_SEQ_FILE_H
+#define _SIM_LINUX_SEQ_FILE_H
+
+#include <linux/fs.h>
+
+struct seq_file {
+	void *private;
+};
+
+static inline __attribute__((format(printf, 2, 3)))
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+}
+
+static inline void seq_puts(struct seq_file *m, const char *s)
+{
+}
+
+static inline int single_open(struct file *file,
+			      int (*show)(struct seq_file *m, void *v), void *data)
+{
+	return 0;
+}
+
+#define seq_read	NULL
+#define seq_lseek	noop_llseek
+#define single_release	NULL
+
+#define DEFINE_SHOW_ATTRIBUTE(__name)					\
+static int __name ## _open(struct inode *inode, struct file *file)	\
+{									\
+	return single_open(file, __name ## _show, inode->i_private);	\
+}									\
+									\
+static const struct file_operations __name ## _fops = {			\
+	.owner		= THIS_MODULE,					\
+	.open		= __name ## _open,				\
+	.read		= seq_read,					\
+	.llseek		= seq_lseek,					\
+	.release	= single_release,				\
+}
+
+#endif
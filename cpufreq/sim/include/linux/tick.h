@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Idle time as the simulated cpu accumulated it, see sim.c. */
+
+#ifndef _SIM_LINUX_TICK_H
+#define _SIM_LINUX_TICK_H
+
+#include <linux/kernel.h>
+
+u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time);
+
+#endif
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Timers never fire under the simulator. */
+
+#ifndef _SIM_LINUX_TIMER_H
+#define _SIM_LINUX_TIMER_H
+
+#include <linux/kernel.h>
+
+struct timer_list {
+	void (*function)(unsigned long data);
+	unsigned long data;
+	unsigned long expires;
+};
+
+#define jiffies			((unsigned long)(ktime_get_ns() / TICK_NSEC))
+#define msecs_to_jiffies(m)	((unsigned long)(m) * HZ / 1000)
+#define jiffies_to_usecs(j)	((unsigned int)((j) * (USEC_PER_SEC / HZ)))
+
+static inline void setup_timer(struct timer_list *timer,
+			       void (*function)(unsigned long), unsigned long data)
+{
+	timer->function = function;
+	timer->data = data;
+}
+
+static inline int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	timer->expires = expires;
+	return 0;
+}
+
+static inline int del_timer(struct timer_list *timer)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Tracepoints compile to nothing, only their prototype is kept. */
+
+#ifndef _SIM_LINUX_TRACEPOINT_H
+#define _SIM_LINUX_TRACEPOINT_H
+
+#include <linux/kernel.h>
+
+#define TP_PROTO(args...)	args
+#define TP_ARGS(args...)	args
+
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)	\
+	static inline void trace_##name(proto) { }
+
+#endif
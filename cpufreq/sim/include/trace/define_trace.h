@@ -0,0 +1,2 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* trace_*() are empty inlines already, see linux/tracepoint.h */
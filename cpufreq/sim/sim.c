@@ -0,0 +1,676 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Replays recorded per-cpu load through a governor's own decision code
+ * and reports what its choices would have cost, without root or the
+ * hardware. The governor source is compiled unchanged against a mock of
+ * the kernel (include/) and of the common dbs code (sim_dbs.c); this
+ * file is the scheduler tick, the cpufreq driver and the cpus.
+ *
+ * Traces are text, one sample per line, '#' starts a comment:
+ *
+ *	<time s> <load cpu0 %> [<load cpu1 %> ...]
+ *
+ * where load is demand in percent of what the cpu does at the highest
+ * frequency, or the per-cpu lines of rapl -d -f,
+ *
+ *	<time s> <package> cpu<N> <MHz> <busy %> <APERF/MPERF>
+ *
+ * whose demand is busy % scaled by MHz over the highest frequency. A
+ * sample holds until the next one of the same cpu.
+ *
+ * The model, stepped every tick:
+ *
+ *  - a cpu does tick * freq / max_freq worth of demand; what it can't do
+ *    is carried over, and a tick that ends with work carried over counts
+ *    as under-provisioned;
+ *  - the governor sees the busy share of each tick through idle time,
+ *    and its hook is called at the end of every tick, as on a busy cpu;
+ *  - a transition takes the latency given with -l, during which the cpu
+ *    runs at the lower of the two frequencies and pays for the higher;
+ *  - busy power is static + dynamic * (freq / max_freq)^3, or the power
+ *    column of an efficiency table (-e), idle power is flat.
+ */
+
+#include <ctype.h>
+#include <getopt.h>
+
+#include <linux/kernel.h>
+#include <linux/cpufreq.h>
+#include <linux/sched/cpufreq.h>
+#include <linux/tick.h>
+
+#include "sim.h"
+
+#define SIM_MAX_FREQS	64
+#define SIM_MAX_TUNABLES 32
+
+struct sim_sample {
+	u64 time_us;
+	double demand;	/* percent of the work done at max_freq */
+};
+
+struct sim_cpu {
+	struct sim_sample *samples;
+	unsigned int nr_samples, size, next;
+	struct sim_policy *policy;
+	struct update_util_data *hook;
+	double idle_us;
+	double backlog_us;	/* of work at max_freq */
+	u64 underprov_us;
+	double energy_j;
+};
+
+struct sim_policy {
+	struct cpufreq_policy policy;
+	/* running at min(from, to) for the price of max(from, to) until switch_us */
+	unsigned int from, to;
+	u64 switch_us;
+	unsigned long transitions;
+	unsigned long evaluations;
+	u64 residency_us[SIM_MAX_FREQS];
+};
+
+static struct {
+	unsigned int min_mhz, max_mhz, step_mhz;
+	unsigned int latency_us;
+	unsigned int tick_us;
+	bool shared;
+	double static_w, dynamic_w, idle_w;
+	const char *tunables[SIM_MAX_TUNABLES];
+	unsigned int nr_tunables;
+	bool verbose;
+	bool kernel_log;
+} opt = {
+	.min_mhz = 800,
+	.max_mhz = 3000,
+	.step_mhz = 100,
+	.latency_us = 10,
+	.tick_us = 1000,
+	.static_w = 0.5,
+	.dynamic_w = 4.5,
+	.idle_w = 0.1,
+};
+
+/* busy power from an efficiency table, see store_efficiency_table() */
+static struct {
+	unsigned int nr;
+	unsigned int freq[SIM_MAX_FREQS];	/* kHz */
+	double watts[SIM_MAX_FREQS];
+} power_table;
+
+static struct cpufreq_frequency_table freq_table[SIM_MAX_FREQS + 1];
+static struct sim_cpu cpus[NR_CPUS];
+static unsigned int nr_cpus;
+static struct sim_policy policies[NR_CPUS];
+static unsigned int nr_policies;
+static u64 sim_now_us;
+
+struct cpumask sim_online_mask;
+unsigned int sim_cpu;
+
+/************************** kernel ************************/
+
+u64 ktime_get_ns(void)
+{
+	return sim_now_us * NSEC_PER_USEC;
+}
+
+int printk(const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (!opt.kernel_log)
+		return 0;
+
+	/* KERN_<level> */
+	if (fmt[0] == '\001' && fmt[1])
+		fmt += 2;
+
+	va_start(args, fmt);
+	n = vfprintf(stderr, fmt, args);
+	va_end(args);
+	if (n > 0 && fmt[strlen(fmt) - 1] != '\n')
+		fputc('\n', stderr);
+
+	return n;
+}
+
+u64 get_cpu_idle_time_us(int cpu, u64 *last_update_time)
+{
+	if (last_update_time)
+		*last_update_time = sim_now_us;
+
+	return (u64)cpus[cpu].idle_us;
+}
+
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+				  void (*func)(struct update_util_data *data, u64 time,
+					       unsigned int flags))
+{
+	data->func = func;
+	cpus[cpu].hook = data;
+}
+
+void cpufreq_remove_update_util_hook(int cpu)
+{
+	cpus[cpu].hook = NULL;
+}
+
+int cpufreq_register_governor(struct cpufreq_governor *governor)
+{
+	return 0;
+}
+
+void cpufreq_unregister_governor(struct cpufreq_governor *governor)
+{
+}
+
+struct cpufreq_policy *cpufreq_cpu_get_raw(unsigned int cpu)
+{
+	return cpu < nr_cpus ? &cpus[cpu].policy->policy : NULL;
+}
+
+/* the driver: takes the table entry right away, the hardware lags by latency_us */
+int __cpufreq_driver_target(struct cpufreq_policy *policy,
+			    unsigned int target_freq, unsigned int relation)
+{
+	struct sim_policy *p = container_of(policy, struct sim_policy, policy);
+	unsigned int freq;
+
+	freq = policy->freq_table[cpufreq_frequency_table_target(policy, target_freq,
+								 relation)].frequency;
+	if (freq == policy->cur)
+		return 0;
+
+	/* a change during a change starts from where the first one runs */
+	p->from = sim_now_us < p->switch_us ? min(p->from, p->to) : p->to;
+	p->to = freq;
+	p->switch_us = sim_now_us + opt.latency_us;
+	policy->cur = freq;
+	p->transitions++;
+
+	return 0;
+}
+
+void sim_governor_ran(struct cpufreq_policy *policy)
+{
+	container_of(policy, struct sim_policy, policy)->evaluations++;
+}
+
+/************************** model ************************/
+
+static double busy_watts(unsigned int freq)
+{
+	double x = (double)freq / (opt.max_mhz * 1000);
+	unsigned int i;
+
+	if (!power_table.nr)
+		return opt.static_w + opt.dynamic_w * x * x * x;
+
+	if (freq <= power_table.freq[0])
+		return power_table.watts[0];
+	for (i = 1; i < power_table.nr; i++) {
+		if (freq <= power_table.freq[i])
+			return power_table.watts[i - 1] +
+			       (power_table.watts[i] - power_table.watts[i - 1]) *
+			       (freq - power_table.freq[i - 1]) /
+			       (power_table.freq[i] - power_table.freq[i - 1]);
+	}
+
+	return power_table.watts[power_table.nr - 1];
+}
+
+static double demand_at(struct sim_cpu *c, u64 time_us)
+{
+	while (c->next + 1 < c->nr_samples && c->samples[c->next + 1].time_us <= time_us)
+		c->next++;
+
+	return c->nr_samples ? c->samples[c->next].demand : 0;
+}
+
+/* dt us at run kHz, paid for at pay kHz */
+static void run_cpu(struct sim_cpu *c, double demand, unsigned int run,
+		    unsigned int pay, u64 dt)
+{
+	double capacity = (double)dt * run / (opt.max_mhz * 1000);
+	double work = c->backlog_us + demand * dt / 100;
+	double done = work < capacity ? work : capacity;
+	double busy = capacity > 0 ? done / capacity : 1;
+
+	c->backlog_us = work - done;
+	/* less than a ns of work left is rounding */
+	if (c->backlog_us > 1e-3)
+		c->underprov_us += dt;
+	else
+		c->backlog_us = 0;
+
+	c->idle_us += (1 - busy) * dt;
+	c->energy_j += (busy * busy_watts(pay) + (1 - busy) * opt.idle_w) * dt / USEC_PER_SEC;
+}
+
+static void step_cpu(struct sim_cpu *c, u64 start, u64 end)
+{
+	struct sim_policy *p = c->policy;
+	double demand = demand_at(c, start);
+	u64 split;
+
+	if (start < p->switch_us) {
+		split = min(end, p->switch_us);
+		run_cpu(c, demand, min(p->from, p->to), max(p->from, p->to), split - start);
+		start = split;
+	}
+	if (start < end)
+		run_cpu(c, demand, p->to, p->to, end - start);
+}
+
+static u64 simulate(void)
+{
+	u64 now, end, duration = 0;
+	struct sim_sample *last;
+	unsigned int i;
+	int index;
+
+	for (i = 0; i < nr_cpus; i++) {
+		if (!cpus[i].nr_samples)
+			continue;
+		last = &cpus[i].samples[cpus[i].nr_samples - 1];
+		/* the last sample lasts as long as the one before it */
+		end = last->time_us + (cpus[i].nr_samples > 1 ?
+				       last->time_us - last[-1].time_us : opt.tick_us);
+		duration = max(duration, end);
+	}
+
+	for (now = 0; now < duration; now = end) {
+		end = min(now + opt.tick_us, duration);
+
+		for (i = 0; i < nr_cpus; i++)
+			step_cpu(&cpus[i], now, end);
+		for (i = 0; i < nr_policies; i++) {
+			index = cpufreq_frequency_table_get_index(&policies[i].policy,
+								  policies[i].policy.cur);
+			if (index >= 0)
+				policies[i].residency_us[index] += end - now;
+		}
+
+		sim_now_us = end;
+		for (i = 0; i < nr_cpus; i++) {
+			if (!cpus[i].hook)
+				continue;
+			sim_cpu = i;
+			cpus[i].hook->func(cpus[i].hook, ktime_get_ns(), 0);
+		}
+	}
+
+	return duration;
+}
+
+/************************** setup ************************/
+
+static void add_sample(unsigned int cpu, u64 time_us, double demand)
+{
+	struct sim_cpu *c = &cpus[cpu];
+
+	if (c->nr_samples == c->size) {
+		c->size = c->size ? 2 * c->size : 1024;
+		c->samples = realloc(c->samples, c->size * sizeof(*c->samples));
+		if (!c->samples) {
+			fprintf(stderr, "out of memory\n");
+			exit(-1);
+		}
+	}
+	c->samples[c->nr_samples].time_us = time_us;
+	c->samples[c->nr_samples].demand = demand < 0 ? 0 : demand > 100 ? 100 : demand;
+	c->nr_samples++;
+	nr_cpus = max(nr_cpus, cpu + 1);
+}
+
+static int load_trace(const char *path)
+{
+	char line[4096], *p, *end;
+	double time, first = -1, load, mhz;
+	unsigned int cpu, lineno = 0;
+	int package;
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		p = line + strspn(line, " \t");
+		if (*p == '#' || *p == '\n' || !*p)
+			continue;
+
+		time = strtod(p, &end);
+		if (end == p) {
+			fprintf(stderr, "%s:%u: no time\n", path, lineno);
+			fclose(f);
+			return -1;
+		}
+		if (first < 0)
+			first = time;
+		time = (time - first) * USEC_PER_SEC;
+
+		/* rapl -f names the domain in the third column, only cpus are used */
+		strtod(end, &p);
+		p += strspn(p, " \t");
+		if (isalpha(*p)) {
+			if (sscanf(end, "%d cpu%u %lf %lf", &package, &cpu, &mhz, &load) == 4 &&
+			    cpu < NR_CPUS)
+				add_sample(cpu, (u64)time, load * mhz / opt.max_mhz);
+			continue;
+		}
+
+		for (cpu = 0, p = end; cpu < NR_CPUS; cpu++, p = end) {
+			load = strtod(p, &end);
+			if (end == p)
+				break;
+			add_sample(cpu, (u64)time, load);
+		}
+	}
+	fclose(f);
+
+	if (!nr_cpus) {
+		fprintf(stderr, "%s: no samples\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int load_power_table(const char *path)
+{
+	unsigned int freq, mw, perf;
+	char line[256];
+	FILE *f = fopen(path, "r");
+
+	if (!f) {
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) && power_table.nr < SIM_MAX_FREQS) {
+		if (sscanf(line, "%u %u %u", &freq, &mw, &perf) != 3)
+			continue;
+		if (power_table.nr && freq <= power_table.freq[power_table.nr - 1]) {
+			fprintf(stderr, "%s: frequencies must increase\n", path);
+			fclose(f);
+			return -1;
+		}
+		power_table.freq[power_table.nr] = freq;
+		power_table.watts[power_table.nr] = mw / 1000.0;
+		power_table.nr++;
+	}
+	fclose(f);
+
+	if (!power_table.nr) {
+		fprintf(stderr, "%s: no \"<kHz> <mW> <perf>\" lines\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void setup_policies(void)
+{
+	struct sim_policy *p;
+	unsigned int i, n = 0, freq;
+
+	for (freq = opt.min_mhz; freq <= opt.max_mhz && n < SIM_MAX_FREQS; freq += opt.step_mhz)
+		freq_table[n++].frequency = freq * 1000;
+	freq_table[n].frequency = CPUFREQ_TABLE_END;
+
+	for (i = 0; i < nr_cpus; i++) {
+		cpumask_set_cpu(i, &sim_online_mask);
+
+		if (!opt.shared || !nr_policies) {
+			p = &policies[nr_policies++];
+			p->policy.cpu = i;
+			p->policy.cpuinfo.min_freq = freq_table[0].frequency;
+			p->policy.cpuinfo.max_freq = freq_table[n - 1].frequency;
+			p->policy.cpuinfo.transition_latency = opt.latency_us * NSEC_PER_USEC;
+			p->policy.min = p->policy.cpuinfo.min_freq;
+			p->policy.max = p->policy.cpuinfo.max_freq;
+			p->policy.cur = p->policy.max;
+			p->policy.freq_table = freq_table;
+			p->from = p->to = p->policy.cur;
+		}
+		cpumask_set_cpu(i, policies[nr_policies - 1].policy.cpus);
+		cpus[i].policy = &policies[nr_policies - 1];
+	}
+}
+
+static struct governor_attr *find_tunable(const char *name, size_t len)
+{
+	struct attribute **attr;
+
+	for (attr = sim_governor.attributes; *attr; attr++)
+		if (strlen((*attr)->name) == len && !strncmp((*attr)->name, name, len))
+			return container_of(*attr, struct governor_attr, attr);
+
+	return NULL;
+}
+
+/* name=value, or name=@file for the whole file */
+static int set_tunable(const char *arg)
+{
+	const char *value = strchr(arg, '=');
+	struct governor_attr *attr;
+	char buf[PAGE_SIZE];
+	size_t n;
+	FILE *f;
+
+	if (!value || !(attr = find_tunable(arg, value - arg)) || !attr->store) {
+		fprintf(stderr, "%s has no tunable %.*s\n", sim_governor.name,
+			value ? (int)(value - arg) : (int)strlen(arg), arg);
+		return -1;
+	}
+	value++;
+
+	if (*value == '@') {
+		f = fopen(value + 1, "r");
+		if (!f) {
+			fprintf(stderr, "could not open %s: %s\n", value + 1, strerror(errno));
+			return -1;
+		}
+		n = fread(buf, 1, sizeof(buf) - 1, f);
+		buf[n] = '\0';
+		fclose(f);
+	} else {
+		snprintf(buf, sizeof(buf), "%s", value);
+	}
+
+	if (attr->store(sim_dbs_attr_set(&policies[0].policy), buf, strlen(buf)) < 0) {
+		fprintf(stderr, "%s: invalid value for %s\n", value, attr->attr.name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/************************** report ************************/
+
+static void report(const char *trace, u64 duration)
+{
+	double energy, total_energy = 0, seconds = (double)duration / USEC_PER_SEC;
+	u64 underprov, total_underprov = 0;
+	unsigned long total_transitions = 0, total_evaluations = 0;
+	struct cpufreq_frequency_table *pos;
+	struct attribute **attr;
+	struct governor_attr *ga;
+	char buf[PAGE_SIZE];
+	unsigned int i, j, n;
+	int idx;
+
+	printf("# %s %s: %u cpus, %.3f s, %u-%u MHz, latency %u us, tick %u us\n",
+	       sim_governor.name, trace, nr_cpus, seconds, opt.min_mhz, opt.max_mhz,
+	       opt.latency_us, opt.tick_us);
+
+	for (attr = sim_governor.attributes; opt.verbose && *attr; attr++) {
+		ga = container_of(*attr, struct governor_attr, attr);
+		if (ga->show(sim_dbs_attr_set(&policies[0].policy), buf) <= 0)
+			continue;
+		/* one line per tunable, the efficiency table joined up */
+		for (j = 0; buf[j]; j++)
+			if (buf[j] == '\n' && buf[j + 1])
+				buf[j] = ',';
+		printf("# %s %s", (*attr)->name, buf);
+	}
+
+	printf("# policy\tcpus\tenergy(J)\tpower(W)\tunderprov(ms)\tunderprov(%%)\ttransitions\tevaluations\n");
+	for (i = 0; i < nr_policies; i++) {
+		energy = 0;
+		underprov = 0;
+		n = cpumask_weight(policies[i].policy.cpus);
+		for (j = 0; j < nr_cpus; j++) {
+			if (cpus[j].policy != &policies[i])
+				continue;
+			energy += cpus[j].energy_j;
+			underprov += cpus[j].underprov_us;
+		}
+		printf("policy%u\t%u\t%.3f\t%.3f\t%.1f\t%.2f\t%lu\t%lu\n",
+		       policies[i].policy.cpu, n, energy, energy / seconds,
+		       underprov / 1000.0, 100.0 * underprov / (n * duration),
+		       policies[i].transitions, policies[i].evaluations);
+		total_energy += energy;
+		total_underprov += underprov;
+		total_transitions += policies[i].transitions;
+		total_evaluations += policies[i].evaluations;
+	}
+	printf("total\t%u\t%.3f\t%.3f\t%.1f\t%.2f\t%lu\t%lu\n",
+	       nr_cpus, total_energy, total_energy / seconds, total_underprov / 1000.0,
+	       100.0 * total_underprov / (nr_cpus * duration), total_transitions,
+	       total_evaluations);
+
+	if (!opt.verbose)
+		return;
+
+	printf("# residency(ms)\tMHz");
+	for (i = 0; i < nr_policies; i++)
+		printf("\tpolicy%u", policies[i].policy.cpu);
+	printf("\n");
+	cpufreq_for_each_valid_entry_idx(pos, freq_table, idx) {
+		printf("residency\t%u", pos->frequency / 1000);
+		for (i = 0; i < nr_policies; i++)
+			printf("\t%.1f", policies[i].residency_us[idx] / 1000.0);
+		printf("\n");
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options] trace\n", prog);
+	printf("\t-f min,max,step   : frequency table in MHz (default %u,%u,%u)\n",
+	       opt.min_mhz, opt.max_mhz, opt.step_mhz);
+	printf("\t-l us             : transition latency (default %u)\n", opt.latency_us);
+	printf("\t-t us             : scheduler tick, the governor's hook runs every tick (default %u)\n",
+	       opt.tick_us);
+	printf("\t-c                : all cpus in one policy, instead of one policy per cpu\n");
+	printf("\t-P static,dyn,idle: power model in W (default %.1f,%.1f,%.1f)\n",
+	       opt.static_w, opt.dynamic_w, opt.idle_w);
+	printf("\t-e file           : busy power per frequency from an efficiency table\n");
+	printf("\t-s name=value     : set a governor tunable, value @file reads it from file\n");
+	printf("\t-v                : also print the tunables and the residency per frequency\n");
+	printf("\t-k                : print the governor's printk() output to stderr\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const struct cpufreq_governor *gov;
+	u64 duration;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "ce:f:hkl:P:s:t:v")) != -1) {
+		switch (c) {
+		case 'c':
+			opt.shared = true;
+			break;
+		case 'e':
+			if (load_power_table(optarg))
+				exit(-1);
+			break;
+		case 'f':
+			if (sscanf(optarg, "%u,%u,%u", &opt.min_mhz, &opt.max_mhz, &opt.step_mhz) != 3 ||
+			    !opt.min_mhz || opt.max_mhz < opt.min_mhz || !opt.step_mhz) {
+				fprintf(stderr, "-f takes min,max,step in MHz\n");
+				exit(-1);
+			}
+			break;
+		case 'k':
+			opt.kernel_log = true;
+			break;
+		case 'l':
+			opt.latency_us = atoi(optarg);
+			break;
+		case 'P':
+			if (sscanf(optarg, "%lf,%lf,%lf", &opt.static_w, &opt.dynamic_w,
+				   &opt.idle_w) != 3) {
+				fprintf(stderr, "-P takes static,dynamic,idle in W\n");
+				exit(-1);
+			}
+			break;
+		case 's':
+			if (opt.nr_tunables < SIM_MAX_TUNABLES)
+				opt.tunables[opt.nr_tunables++] = optarg;
+			break;
+		case 't':
+			opt.tick_us = atoi(optarg);
+			if (!opt.tick_us) {
+				fprintf(stderr, "-t takes a tick in us\n");
+				exit(-1);
+			}
+			break;
+		case 'v':
+			opt.verbose = true;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (optind >= argc) {
+		usage(argv[0]);
+		exit(-1);
+	}
+
+	if (load_trace(argv[optind]))
+		exit(-1);
+	setup_policies();
+
+	if (sim_governor.init()) {
+		fprintf(stderr, "%s: init failed\n", sim_governor.name);
+		exit(-1);
+	}
+	gov = sim_governor.gov;
+	for (i = 0; i < nr_policies; i++) {
+		policies[i].policy.governor = sim_governor.gov;
+		if (gov->init(&policies[i].policy) || gov->start(&policies[i].policy)) {
+			fprintf(stderr, "%s: could not start on policy%u\n", sim_governor.name,
+				policies[i].policy.cpu);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < opt.nr_tunables; i++)
+		if (set_tunable(opt.tunables[i]))
+			exit(-1);
+
+	duration = simulate();
+	report(argv[optind], duration);
+
+	for (i = 0; i < nr_policies; i++) {
+		gov->stop(&policies[i].policy);
+		gov->exit(&policies[i].policy);
+	}
+	sim_governor.exit();
+
+	for (i = 0; i < nr_cpus; i++)
+		free(cpus[i].samples);
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * What sim.c, the mock dbs core (sim_dbs.c) and the governor wrappers
+ * (sim_<governor>.c) share.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <linux/cpufreq.h>
+
+/* a governor module as built for the kernel, see sim_ondemandx.c */
+struct sim_governor {
+	const char *name;
+	struct cpufreq_governor *gov;
+	struct attribute **attributes;	/* its sysfs tunables */
+	int (*init)(void);		/* module_init() */
+	void (*exit)(void);		/* module_exit() */
+};
+
+extern const struct sim_governor sim_governor;
+
+/* sim_dbs.c */
+struct gov_attr_set *sim_dbs_attr_set(struct cpufreq_policy *policy);
+
+/* sim.c, called every time the governor's gov_dbs_update() runs */
+void sim_governor_ran(struct cpufreq_policy *policy);
+
+#endif
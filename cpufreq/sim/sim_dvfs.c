@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * dvfs, unchanged from the snapshot, for the simulator. Its network and
+ * memory timer never fires, so network_load stays 0 and dvfs_update()
+ * works from cpu load alone.
+ */
+
+#include "../dvfs-original/src/cpufreq_dvfs.c"
+
+#include "sim.h"
+
+const struct sim_governor sim_governor = {
+	.name = "dvfs",
+	.gov = CPU_FREQ_GOV_DVFS,
+	.attributes = dvfs_attributes,
+	.init = cpufreq_gov_dbs_init,
+	.exit = cpufreq_gov_dbs_exit,
+};
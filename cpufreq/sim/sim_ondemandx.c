@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* ondemandx, unchanged from the module, for the simulator */
+
+#include "../ondemandx/ondemandx.c"
+
+#include "sim.h"
+
+const struct sim_governor sim_governor = {
+	.name = ONDEMANDX,
+	.gov = &CPU_FREQ_GOV_ONDEMANDX,
+	.attributes = od_attributes,
+	.init = cpufreq_ondemandx_dbs_init,
+	.exit = cpufreq_ondemandx_dbs_exit,
+};
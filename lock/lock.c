@@ -1,3 +1,6 @@
+// Compile with:   make -C ../rapl && gcc -O2 -Wall -I../rapl -I../topology -o lock lock.c ../rapl/librapl.a -lpthread -lm
+
+#define _GNU_SOURCE
 #include <errno.h>
 #include <pthread.h>
 #include <sched.h>
@@ -8,7 +11,12 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "rapl.h"
+#include "topology.h"
 
+static int run_script(char *argv[]);
 static void set_max_speed_for_cpu();
 static void reset_all_cpus();
 static void set_pid_to_env();
@@ -19,6 +27,7 @@ static void allocate_primes();
 static void deallocate_primes();
 static void stress_primes(unsigned long n);
 static void print_primes();
+static void pin_thread_attr(pthread_attr_t *attr, int cpu);
 
 typedef struct _pr
 {
@@ -29,18 +38,47 @@ typedef struct _pr
 pthread_mutex_t rs_mutex = PTHREAD_MUTEX_INITIALIZER;
 unsigned long *primes;
 
+// runs a governor script in a child, exec'ing it here would end the measurement
+static int run_script(char *argv[])
+{
+    fflush(stdout);
+    pid_t pid = fork();
+
+    if (pid == -1)
+    {
+        printf("fork failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (pid == 0)
+    {
+        execvp(argv[0], argv);
+        printf("exec failed: %s\n", strerror(errno));
+        _exit(127);
+    }
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+    {
+        if (errno != EINTR)
+        {
+            printf("waitpid failed: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
 static void reset_all_cpus()
 {
     printf("resetting all CPUs\n");
     char *cmd = "./reset-governor.sh";
     char *argv[] = {cmd, NULL};
-    int result = execvp(cmd, argv);
 
-    if (result == -1)
+    if (run_script(argv) != 0)
     {
         printf("FAIL: couldn't reset all CPUs\n");
-        printf("exec failed: %s\n", strerror(errno));
-        exit(1);
     }
 }
 
@@ -48,16 +86,13 @@ static void set_max_speed_for_cpu(int cpu)
 {
     printf("setting CPU [%d] to max speed\n", cpu);
     char *cmd = "./governor.sh";
-    char cpu_str[3];
+    char cpu_str[12];
     sprintf(cpu_str, "%d", cpu);
     char *argv[] = {cmd, cpu_str, NULL};
 
-    int result = execvp(cmd, argv);
-    if (result == -1)
+    if (run_script(argv) != 0)
     {
         printf("FAIL: couldn't set cpu [%d] max speed\n", cpu);
-        printf("exec failed: %s\n", strerror(errno));
-        exit(1);
     }
 }
 
@@ -128,13 +163,27 @@ static void *critical_section(void *data)
     printf("HELLO\n");
 
     pthread_mutex_lock(&rs_mutex);
+    rapl_region_begin("critical_section");
     allocate_primes(r1);
     stress_primes(r1);
     print_primes(r1);
     deallocate_primes();
+    rapl_region_end("critical_section");
     pthread_mutex_unlock(&rs_mutex);
 
     reset_all_cpus();
+
+    return NULL;
+}
+
+static void pin_thread_attr(pthread_attr_t *attr, int cpu)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_attr_init(attr);
+    pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
 }
 
 static void set_pid_to_env()
@@ -163,15 +212,32 @@ int main(int argc, char *argv[])
     pr ranges = {r1, r2};
 
     pthread_t thread1, thread2;
+    pthread_attr_t attr1;
     int rc1, rc2;
 
+    // pin the worker so the cpu whose governor it sets is the one it runs on
+    struct topology topo;
+    int cpu;
+    if (topology_init(&topo) != 0)
+    {
+        printf("FAIL: couldn't read cpu topology\n");
+        exit(1);
+    }
+    topology_spread(&topo, &cpu, 1);
+    topology_free(&topo);
+    pin_thread_attr(&attr1, cpu);
+
     pthread_mutex_init(&rs_mutex, NULL);
+    rapl_init();
 
-    rc1 = pthread_create(&thread1, NULL, &critical_section, (void *)&ranges);
+    rc1 = pthread_create(&thread1, &attr1, &critical_section, (void *)&ranges);
     // rc2 = pthread_create(&thread2, NULL, &critical_section, (void *)&ranges);
 
     pthread_join(thread1, NULL);
     // pthread_join(thread2, NULL);
+    pthread_attr_destroy(&attr1);
+    rapl_region_report(stdout);
+    rapl_finish();
 
     pthread_mutex_destroy(&rs_mutex);
 
@@ -21,7 +21,8 @@
 /* the sysfs powercap interface got into the kernel in 			*/
 /*	2d281d8196e38dd (3.13)						*/
 /*									*/
-/* Compile with:   gcc -O2 -Wall -o rapl-read rapl-read.c -lm		*/
+/* Compile with:							*/
+/*	gcc -O2 -Wall -o rapl-read rapl-read.c ../topology/topology.c -lm	*/
 /*									*/
 /* Vince Weaver -- vincent.weaver @ maine.edu -- 11 September 2015	*/
 /*									*/
@@ -40,6 +41,9 @@
 #include <sys/syscall.h>
 #include <linux/perf_event.h>
 
+#include "../rapl/rapl_accumulator.h"
+#include "../topology/topology.h"
+
 #define MSR_RAPL_POWER_UNIT		0x606
 
 /*
@@ -73,6 +77,9 @@
 /* PSYS RAPL Domain */
 #define MSR_PLATFORM_ENERGY_STATUS	0x64d
 
+/* Energy status counters are 32 bits, the upper half is reserved */
+#define ENERGY_STATUS_MASK	0xffffffffULL
+
 /* RAPL UNIT BITMASK */
 #define POWER_UNIT_OFFSET	0
 #define POWER_UNIT_MASK		0x0F
@@ -254,41 +261,42 @@ static int detect_cpu(void) {
 	return model;
 }
 
-#define MAX_CPUS	1024
 #define MAX_PACKAGES	16
 
 static int total_cores=0,total_packages=0;
 static int package_map[MAX_PACKAGES];
 
+static struct topology topo;
+
 static int detect_packages(void) {
 
-	char filename[BUFSIZ];
-	FILE *fff;
-	int package;
 	int i;
 
 	for(i=0;i<MAX_PACKAGES;i++) package_map[i]=-1;
 
+	if (topology_init(&topo)) {
+		printf("\tCould not read cpu topology\n");
+		exit(-1);
+	}
+
 	printf("\t");
-	for(i=0;i<MAX_CPUS;i++) {
-		sprintf(filename,"/sys/devices/system/cpu/cpu%d/topology/physical_package_id",i);
-		fff=fopen(filename,"r");
-		if (fff==NULL) break;
-		fscanf(fff,"%d",&package);
-		printf("%d (%d)",i,package);
+	for(i=0;i<topo.nr_cpus;i++) {
+		printf("%d (%d)",i,topo.cpus[i].package_id);
 		if (i%8==7) printf("\n\t"); else printf(", ");
-		fclose(fff);
+	}
 
-		if (package_map[package]==-1) {
-			total_packages++;
-			package_map[package]=i;
-		}
+	printf("\n");
 
+	if (topo.nr_packages>MAX_PACKAGES) {
+		printf("\t%d packages detected, only %d supported\n",
+			topo.nr_packages,MAX_PACKAGES);
+		exit(-1);
 	}
 
-	printf("\n");
+	total_packages=topo.nr_packages;
+	for(i=0;i<total_packages;i++) package_map[i]=topo.package_cpu[i];
 
-	total_cores=i;
+	total_cores=topo.nr_cpus;
 
 	printf("\tDetected %d cores in %d packages\n\n",
 		total_cores,total_packages);
@@ -300,17 +308,31 @@ static int detect_packages(void) {
 /*******************************/
 /* MSR code                    */
 /*******************************/
+
+/* Energy in Joules between two raw counter reads, correcting one wrap */
+static double msr_energy_delta(long long before, long long after,
+		double energy_units) {
+
+	struct rapl_accumulator acc;
+
+	rapl_accumulator_init(&acc,RAPL_MSR_ENERGY_RANGE,
+		before&ENERGY_STATUS_MASK);
+	rapl_accumulator_update(&acc,after&ENERGY_STATUS_MASK);
+
+	return (double)acc.total*energy_units;
+}
+
 static int rapl_msr(int core, int cpu_model) {
 
 	int fd;
 	long long result;
 	double power_units,time_units;
 	double cpu_energy_units[MAX_PACKAGES],dram_energy_units[MAX_PACKAGES];
-	double package_before[MAX_PACKAGES],package_after[MAX_PACKAGES];
-	double pp0_before[MAX_PACKAGES],pp0_after[MAX_PACKAGES];
-	double pp1_before[MAX_PACKAGES],pp1_after[MAX_PACKAGES];
-	double dram_before[MAX_PACKAGES],dram_after[MAX_PACKAGES];
-	double psys_before[MAX_PACKAGES],psys_after[MAX_PACKAGES];
+	long long package_before[MAX_PACKAGES];
+	long long pp0_before[MAX_PACKAGES];
+	long long pp1_before[MAX_PACKAGES];
+	long long dram_before[MAX_PACKAGES];
+	long long psys_before[MAX_PACKAGES];
 	double thermal_spec_power,minimum_power,maximum_power,time_window;
 	int j;
 
@@ -486,21 +508,21 @@ static int rapl_msr(int core, int cpu_model) {
 
 		/* Package Energy */
 		result=read_msr(fd,MSR_PKG_ENERGY_STATUS);
-		package_before[j]=(double)result*cpu_energy_units[j];
+		package_before[j]=result;
 
 		/* PP0 energy */
 		/* Not available on Knights* */
 		/* Always returns zero on Haswell-EP? */
 		if (pp0_avail) {
 			result=read_msr(fd,MSR_PP0_ENERGY_STATUS);
-			pp0_before[j]=(double)result*cpu_energy_units[j];
+			pp0_before[j]=result;
 		}
 
 		/* PP1 energy */
 		/* not available on *Bridge-EP */
 		if (pp1_avail) {
 	 		result=read_msr(fd,MSR_PP1_ENERGY_STATUS);
-			pp1_before[j]=(double)result*cpu_energy_units[j];
+			pp1_before[j]=result;
 		}
 
 
@@ -508,7 +530,7 @@ static int rapl_msr(int core, int cpu_model) {
 		/* Broadwell have DRAM support too				*/
 		if (dram_avail) {
 			result=read_msr(fd,MSR_DRAM_ENERGY_STATUS);
-			dram_before[j]=(double)result*dram_energy_units[j];
+			dram_before[j]=result;
 		}
 
 
@@ -519,7 +541,7 @@ static int rapl_msr(int core, int cpu_model) {
 			(cpu_model==CPU_KABYLAKE_MOBILE)) {
 
 			result=read_msr(fd,MSR_PLATFORM_ENERGY_STATUS);
-			psys_before[j]=(double)result*cpu_energy_units[j];
+			psys_before[j]=result;
 		}
 
 		close(fd);
@@ -535,42 +557,44 @@ static int rapl_msr(int core, int cpu_model) {
 		printf("\tPackage %d:\n",j);
 
 		result=read_msr(fd,MSR_PKG_ENERGY_STATUS);
-		package_after[j]=(double)result*cpu_energy_units[j];
 		printf("\t\tPackage energy: %.6fJ\n",
-			package_after[j]-package_before[j]);
+			msr_energy_delta(package_before[j],result,
+				cpu_energy_units[j]));
 
-		result=read_msr(fd,MSR_PP0_ENERGY_STATUS);
-		pp0_after[j]=(double)result*cpu_energy_units[j];
-		printf("\t\tPowerPlane0 (cores): %.6fJ\n",
-			pp0_after[j]-pp0_before[j]);
+		if (pp0_avail) {
+			result=read_msr(fd,MSR_PP0_ENERGY_STATUS);
+			printf("\t\tPowerPlane0 (cores): %.6fJ\n",
+				msr_energy_delta(pp0_before[j],result,
+					cpu_energy_units[j]));
+		}
 
 		/* not available on SandyBridge-EP */
 		if (pp1_avail) {
 			result=read_msr(fd,MSR_PP1_ENERGY_STATUS);
-			pp1_after[j]=(double)result*cpu_energy_units[j];
 			printf("\t\tPowerPlane1 (on-core GPU if avail): %.6f J\n",
-				pp1_after[j]-pp1_before[j]);
+				msr_energy_delta(pp1_before[j],result,
+					cpu_energy_units[j]));
 		}
 
 		if (dram_avail) {
 			result=read_msr(fd,MSR_DRAM_ENERGY_STATUS);
-			dram_after[j]=(double)result*dram_energy_units[j];
 			printf("\t\tDRAM: %.6fJ\n",
-				dram_after[j]-dram_before[j]);
+				msr_energy_delta(dram_before[j],result,
+					dram_energy_units[j]));
 		}
 
 		if (psys_avail) {
 			result=read_msr(fd,MSR_PLATFORM_ENERGY_STATUS);
-			psys_after[j]=(double)result*cpu_energy_units[j];
 			printf("\t\tPSYS: %.6fJ\n",
-				psys_after[j]-psys_before[j]);
+				msr_energy_delta(psys_before[j],result,
+					cpu_energy_units[j]));
 		}
 
 		close(fd);
 	}
 	printf("\n");
-	printf("Note: the energy measurements can overflow in 60s or so\n");
-	printf("      so try to sample the counters more often than that.\n\n");
+	printf("Note: the energy counters wrap in 60s or so; one wrap between\n");
+	printf("      samples is corrected, so sample at least that often.\n\n");
 
 	return 0;
 }
@@ -740,10 +764,13 @@ static int rapl_sysfs(int core) {
 
 	char event_names[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
 	char filenames[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
+	char rangefiles[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
 	char basename[MAX_PACKAGES][256];
 	char tempfile[256];
 	long long before[MAX_PACKAGES][NUM_RAPL_DOMAINS];
 	long long after[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	long long range[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	struct rapl_accumulator acc;
 	int valid[MAX_PACKAGES][NUM_RAPL_DOMAINS];
 	int i,j;
 	FILE *fff;
@@ -769,6 +796,7 @@ static int rapl_sysfs(int core) {
 		valid[j][i]=1;
 		fclose(fff);
 		sprintf(filenames[j][i],"%s/energy_uj",basename[j]);
+		sprintf(rangefiles[j][i],"%s/max_energy_range_uj",basename[j]);
 
 		/* Handle subdomains */
 		for(i=1;i<NUM_RAPL_DOMAINS;i++) {
@@ -785,7 +813,23 @@ static int rapl_sysfs(int core) {
 			fclose(fff);
 			sprintf(filenames[j][i],"%s/intel-rapl:%d:%d/energy_uj",
 				basename[j],j,i-1);
+			sprintf(rangefiles[j][i],"%s/intel-rapl:%d:%d/max_energy_range_uj",
+				basename[j],j,i-1);
+
+		}
+	}
 
+	/* energy_uj wraps back to 0 once it reaches max_energy_range_uj */
+	for(j=0;j<total_packages;j++) {
+		for(i=0;i<NUM_RAPL_DOMAINS;i++) {
+			range[j][i]=RAPL_NO_WRAP;
+			if (valid[j][i]) {
+				fff=fopen(rangefiles[j][i],"r");
+				if (fff!=NULL) {
+					fscanf(fff,"%lld",&range[j][i]);
+					fclose(fff);
+				}
+			}
 		}
 	}
 
@@ -828,8 +872,10 @@ static int rapl_sysfs(int core) {
 		printf("\tPackage %d\n",j);
 		for(i=0;i<NUM_RAPL_DOMAINS;i++) {
 			if (valid[j][i]) {
+				rapl_accumulator_init(&acc,range[j][i],before[j][i]);
+				rapl_accumulator_update(&acc,after[j][i]);
 				printf("\t\t%s\t: %lfJ\n",event_names[j][i],
-					((double)after[j][i]-(double)before[j][i])/1000000.0);
+					(double)acc.total/1000000.0);
 			}
 		}
 	}
@@ -0,0 +1,662 @@
+/* librapl -- see rapl.h
+
+perf_event_open() support requires at least Linux 3.14 and to have
+	/proc/sys/kernel/perf_event_paranoid < 1 */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "rapl.h"
+#include "rapl_backend.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+enum rapl_vendor rapl_vendor = RAPL_VENDOR_UNKNOWN;
+int rapl_cpu_family = -1, rapl_cpu_model = -1;
+int rapl_total_cores = 0, rapl_total_packages = 0;
+int rapl_package_map[MAX_PACKAGES];
+struct topology rapl_topo;
+
+// energy-pkg comes first so it leads the event group wherever it exists
+char rapl_domain_names[NUM_RAPL_DOMAINS][30] = {
+	"energy-pkg",
+	"energy-cores",
+	"energy-ram",
+	"energy-gpu",
+	"energy-psys",
+};
+
+struct rapl_domain rapl_domains[NUM_RAPL_DOMAINS];
+
+// layout of a PERF_FORMAT_GROUP read() without ids or times
+struct rapl_group_read
+{
+	uint64_t nr;
+	uint64_t values[NUM_RAPL_DOMAINS];
+};
+
+static int perf_event_open(struct perf_event_attr *hw_event_uptr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+{
+	return syscall(__NR_perf_event_open, hw_event_uptr, pid, cpu, group_fd, flags);
+}
+
+static int check_paranoid(void)
+{
+	int paranoid_value;
+	FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+	if (!f)
+	{
+		fprintf(stderr, "Error! could not open /proc/sys/kernel/perf_event_paranoid %s\n", strerror(errno));
+		// return non-negative paranoid value, since negative means no paranoia
+		return 404;
+	}
+	fscanf(f, "%d", &paranoid_value);
+	fclose(f);
+
+	return paranoid_value;
+}
+
+static int get_perf_event_rapl_type()
+{
+	FILE *f = fopen("/sys/bus/event_source/devices/power/type", "r");
+	if (!f)
+	{
+		printf("could not retrieve perf_event_rapl type\n");
+		return -1;
+	}
+	int type = 0;
+	fscanf(f, "%d", &type);
+	fclose(f);
+
+	return type;
+}
+
+static int get_perf_event_rapl_config(const char *domain)
+{
+	char filename[BUFSIZ];
+	sprintf(filename, "/sys/bus/event_source/devices/power/events/%s", domain);
+	FILE *f = fopen(filename, "r");
+	if (!f)
+	{
+		return -1;
+	}
+	int config = 0;
+	fscanf(f, "event = %x", &config);
+	fclose(f);
+
+	return config;
+}
+
+static double get_perf_event_rapl_scale(const char *domain)
+{
+	char filename[BUFSIZ];
+	sprintf(filename, "/sys/bus/event_source/devices/power/events/%s.scale", domain);
+	FILE *f = fopen(filename, "r");
+	if (!f)
+	{
+		printf("could not retrieve perf_event_rapl scale for %s\n", domain);
+		return -1.0;
+	}
+	double scale = 0.0;
+	fscanf(f, "%lf", &scale);
+	fclose(f);
+
+	return scale;
+}
+
+static int get_perf_event_rapl_units(const char *domain, char *units)
+{
+	char filename[BUFSIZ];
+	sprintf(filename, "/sys/bus/event_source/devices/power/events/%s.unit", domain);
+	FILE *f = fopen(filename, "r");
+
+	if (!f)
+	{
+		printf("could not retrieve perf_event rapl units for %s\n", domain);
+		return -1;
+	}
+	fscanf(f, "%s", units);
+	fclose(f);
+
+	return 0;
+}
+
+/* Reads vendor_id from /proc/cpuinfo into vendor_id and sets rapl_vendor */
+int rapl_detect_vendor(char *vendor_id, size_t len)
+{
+	char buffer[BUFSIZ], id[BUFSIZ] = "";
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	if (!f)
+	{
+		printf("could not open /proc/cpuinfo\n");
+		return -1;
+	}
+
+	while (fgets(buffer, BUFSIZ, f))
+	{
+		if (!strncmp(buffer, "vendor_id", 9))
+		{
+			sscanf(buffer, "%*s%*s%s", id);
+		}
+		else if (!strncmp(buffer, "cpu family", 10))
+		{
+			sscanf(buffer, "%*s%*s%*s%d", &rapl_cpu_family);
+		}
+		else if (!strncmp(buffer, "model\t", 6))
+		{
+			sscanf(buffer, "%*s%*s%d", &rapl_cpu_model);
+			break;
+		}
+	}
+	fclose(f);
+
+	if (!strcmp(id, "GenuineIntel"))
+	{
+		rapl_vendor = RAPL_VENDOR_INTEL;
+	}
+	else if (!strcmp(id, "AuthenticAMD") || !strcmp(id, "HygonGenuine"))
+	{
+		rapl_vendor = RAPL_VENDOR_AMD;
+	}
+	snprintf(vendor_id, len, "%s", id);
+
+	return 0;
+}
+
+int rapl_detect_packages(void)
+{
+	for (int i = 0; i < MAX_PACKAGES; i++)
+	{
+		rapl_package_map[i] = -1;
+	}
+
+	if (topology_init(&rapl_topo) != 0)
+	{
+		printf("could not read cpu topology\n");
+		return -1;
+	}
+
+	if (rapl_topo.nr_packages > MAX_PACKAGES)
+	{
+		printf("%d packages detected, only %d supported\n", rapl_topo.nr_packages, MAX_PACKAGES);
+		topology_free(&rapl_topo);
+		return -1;
+	}
+
+	rapl_total_packages = rapl_topo.nr_packages;
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		rapl_package_map[j] = rapl_topo.package_cpu[j];
+	}
+	rapl_total_cores = rapl_topo.nr_cpus;
+
+	return 0;
+}
+
+/* returns the number of domains found, -1 if there are none */
+int rapl_detect_domains(void)
+{
+	int found = 0;
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		struct rapl_domain *d = &rapl_domains[i];
+
+		d->config = get_perf_event_rapl_config(rapl_domain_names[i]);
+		d->available = d->config != -1;
+		if (!d->available)
+		{
+			continue;
+		}
+		d->scale = get_perf_event_rapl_scale(rapl_domain_names[i]);
+		if (d->scale < 0.0 || get_perf_event_rapl_units(rapl_domain_names[i], d->units) != 0)
+		{
+			d->available = false;
+			continue;
+		}
+		found++;
+	}
+
+	if (!found)
+	{
+		printf("could not find any perf_event rapl domains\n");
+		return -1;
+	}
+
+	return found;
+}
+
+/*
+ * Opens every available domain of a package as one perf event group, led
+ * by the first available domain, so that rapl_read_package() gets all of
+ * them from a single read() on the leader, sampled at the same instant.
+ * Unavailable domains are left at -1. On failure nothing is left open.
+ */
+int rapl_open_groups(int fd[][MAX_PACKAGES], pid_t pid)
+{
+	int type = get_perf_event_rapl_type();
+	int paranoid;
+	struct perf_event_attr attr;
+
+	for (int j = 0; j < MAX_PACKAGES; j++)
+	{
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			fd[i][j] = -1;
+		}
+	}
+
+	if (type < 0)
+	{
+		return -1;
+	}
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		int cpu = rapl_package_map[j];
+		int leader = -1;
+
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			if (!rapl_domains[i].available)
+			{
+				continue;
+			}
+
+			memset(&attr, 0x0, sizeof(attr));
+			attr.type = type;
+			attr.config = rapl_domains[i].config;
+			attr.read_format = PERF_FORMAT_GROUP;
+			// int perf_event_open(struct perf_event_attr *attr,
+			//                     pid_t pid, int cpu, int group_fd,
+			//                     unsigned long flags);
+			fd[i][j] = perf_event_open(&attr, pid, cpu, leader, 0);
+
+			if (fd[i][j] < 0)
+			{
+				if (errno == EACCES)
+				{
+					printf("\n\tNeed root privileges or perf_event_paranoid < 0\n\n");
+					paranoid = check_paranoid();
+
+					if (paranoid > 0)
+					{
+						printf("\t/proc/sys/kernel/perf_event_paranoid is %d\n", paranoid);
+					}
+				}
+				else
+				{
+					printf("\terror opening core %d config %d: %s\n\n", cpu, rapl_domains[i].config, strerror(errno));
+				}
+				fd[i][j] = -1;
+				rapl_close_groups(fd);
+				return -1;
+			}
+
+			if (leader == -1)
+			{
+				leader = fd[i][j];
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Reads all domains of package j with one read() on the group leader.
+ * Group members come back in the order they were opened, which is the
+ * order of the available domains in rapl_domain_names.
+ */
+int rapl_read_package(int fd[][MAX_PACKAGES], int j, long long value[NUM_RAPL_DOMAINS])
+{
+	struct rapl_group_read group;
+	int leader = -1, n = 0;
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS && leader == -1; i++)
+	{
+		leader = fd[i][j];
+	}
+
+	if (read(leader, &group, sizeof(group)) < (ssize_t)sizeof(group.nr))
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		value[i] = fd[i][j] != -1 && n < group.nr ? (long long)group.values[n++] : 0;
+	}
+
+	return 0;
+}
+
+/* closes group members before their leader */
+void rapl_close_groups(int fd[][MAX_PACKAGES])
+{
+	for (int j = 0; j < MAX_PACKAGES; j++)
+	{
+		for (int i = NUM_RAPL_DOMAINS - 1; i >= 0; i--)
+		{
+			if (fd[i][j] != -1)
+			{
+				close(fd[i][j]);
+				fd[i][j] = -1;
+			}
+		}
+	}
+}
+
+/************************** regions ************************/
+
+/*
+ * Every thread owns a table of region slots that only it writes, so
+ * begin/end take no locks and share no cache lines with other threads.
+ * Tables are pushed onto a global list with a CAS the first time a
+ * thread enters a region, and stay there until rapl_finish() so that
+ * rapl_region_report() still sees threads that have exited.
+ */
+struct rapl_region
+{
+	const char *name;
+	bool active;
+	uint64_t count;
+	uint64_t time_ns;
+	uint64_t begin_ns;
+	long long begin[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	long long energy[NUM_RAPL_DOMAINS]; // raw counts summed over packages
+};
+
+struct rapl_thread_regions
+{
+	pid_t tid;
+	_Atomic int nr_regions;
+	struct rapl_region regions[RAPL_MAX_REGIONS];
+	struct rapl_thread_regions *next;
+};
+
+/*
+ * Counts come from the rapl_snapshot page if the module is loaded, a copy
+ * per package, or else from one perf group read() per package. The
+ * snapshot's counters are the raw 32 bit MSRs, hence the mask.
+ */
+static int region_fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
+static struct rapl_backend *region_snapshot;
+static bool region_available[NUM_RAPL_DOMAINS];
+static double region_scale[NUM_RAPL_DOMAINS];
+static unsigned long long region_mask;
+static bool regions_enabled;
+static _Atomic(struct rapl_thread_regions *) all_regions;
+static __thread struct rapl_thread_regions *thread_regions;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* raw counts of every package */
+static void read_all_packages(long long value[MAX_PACKAGES][NUM_RAPL_DOMAINS])
+{
+	struct rapl_snapshot_package p;
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (region_snapshot)
+		{
+			rapl_snapshot_read_package(region_snapshot->snapshot, j, &p);
+			for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+			{
+				value[j][i] = p.energy[i];
+			}
+		}
+		else if (rapl_read_package(region_fd, j, value[j]) != 0)
+		{
+			memset(value[j], 0, sizeof(value[j]));
+		}
+	}
+}
+
+static struct rapl_thread_regions *get_thread_regions(void)
+{
+	struct rapl_thread_regions *head;
+
+	if (thread_regions)
+	{
+		return thread_regions;
+	}
+
+	thread_regions = calloc(1, sizeof(*thread_regions));
+	if (!thread_regions)
+	{
+		return NULL;
+	}
+	thread_regions->tid = syscall(__NR_gettid);
+
+	head = atomic_load(&all_regions);
+	do
+	{
+		thread_regions->next = head;
+	} while (!atomic_compare_exchange_weak(&all_regions, &head, thread_regions));
+
+	return thread_regions;
+}
+
+static struct rapl_region *find_region(const char *name)
+{
+	struct rapl_thread_regions *t = get_thread_regions();
+	int n;
+
+	if (!t)
+	{
+		return NULL;
+	}
+
+	n = atomic_load_explicit(&t->nr_regions, memory_order_relaxed);
+	for (int r = 0; r < n; r++)
+	{
+		if (t->regions[r].name == name || !strcmp(t->regions[r].name, name))
+		{
+			return &t->regions[r];
+		}
+	}
+
+	if (n == RAPL_MAX_REGIONS)
+	{
+		return NULL;
+	}
+
+	t->regions[n].name = name;
+	// publish the slot only once its name is set
+	atomic_store_explicit(&t->nr_regions, n + 1, memory_order_release);
+
+	return &t->regions[n];
+}
+
+int rapl_init(void)
+{
+	struct rapl_backend *snapshot = &rapl_backends[RAPL_BACKEND_SNAPSHOT];
+	char vendor_id[BUFSIZ];
+
+	if (rapl_detect_vendor(vendor_id, sizeof(vendor_id)) != 0 || rapl_detect_packages() != 0)
+	{
+		fprintf(stderr, "librapl: energy counters unavailable, regions are not measured\n");
+		return -1;
+	}
+
+	if (snapshot->open(snapshot) == 0)
+	{
+		region_snapshot = snapshot;
+		region_mask = RAPL_MSR_ENERGY_RANGE - 1;
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			region_available[i] = snapshot->available[i];
+			region_scale[i] = snapshot->scale[i];
+		}
+	}
+	else if (rapl_detect_domains() >= 0 && rapl_open_groups(region_fd, -1) == 0)
+	{
+		region_mask = ~0ULL;
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			region_available[i] = rapl_domains[i].available;
+			region_scale[i] = rapl_domains[i].scale;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "librapl: energy counters unavailable, regions are not measured\n");
+		topology_free(&rapl_topo);
+		return -1;
+	}
+
+	regions_enabled = true;
+	return 0;
+}
+
+void rapl_finish(void)
+{
+	struct rapl_thread_regions *t = atomic_exchange(&all_regions, NULL);
+
+	if (regions_enabled)
+	{
+		if (region_snapshot)
+		{
+			region_snapshot->close(region_snapshot);
+			region_snapshot = NULL;
+		}
+		else
+		{
+			rapl_close_groups(region_fd);
+		}
+		topology_free(&rapl_topo);
+		regions_enabled = false;
+	}
+
+	while (t)
+	{
+		struct rapl_thread_regions *next = t->next;
+		free(t);
+		t = next;
+	}
+	thread_regions = NULL;
+}
+
+void rapl_region_begin(const char *name)
+{
+	struct rapl_region *region;
+
+	if (!regions_enabled || !(region = find_region(name)) || region->active)
+	{
+		return;
+	}
+
+	region->active = true;
+	read_all_packages(region->begin);
+	region->begin_ns = now_ns();
+}
+
+void rapl_region_end(const char *name)
+{
+	// stop the clock and the counters before any bookkeeping
+	uint64_t end_ns = now_ns();
+	long long end[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	struct rapl_region *region;
+
+	if (!regions_enabled)
+	{
+		return;
+	}
+	read_all_packages(end);
+
+	region = find_region(name);
+	if (!region || !region->active)
+	{
+		return;
+	}
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			region->energy[i] += (unsigned long long)(end[j][i] - region->begin[j][i]) & region_mask;
+		}
+	}
+	region->time_ns += end_ns - region->begin_ns;
+	region->count++;
+	region->active = false;
+}
+
+/*
+ * Prints per-region totals over all threads. Call it once the threads
+ * that entered regions are done, the slots are read without locking.
+ */
+void rapl_region_report(FILE *f)
+{
+	struct rapl_region total[RAPL_MAX_REGIONS];
+	int nr_total = 0;
+
+	if (!regions_enabled)
+	{
+		return;
+	}
+
+	memset(total, 0, sizeof(total));
+	for (struct rapl_thread_regions *t = atomic_load(&all_regions); t; t = t->next)
+	{
+		int n = atomic_load_explicit(&t->nr_regions, memory_order_acquire);
+
+		for (int r = 0; r < n; r++)
+		{
+			struct rapl_region *region = &t->regions[r];
+			int k;
+
+			for (k = 0; k < nr_total && strcmp(total[k].name, region->name); k++)
+				;
+			if (k == nr_total)
+			{
+				if (nr_total == RAPL_MAX_REGIONS)
+				{
+					continue;
+				}
+				total[nr_total++].name = region->name;
+			}
+
+			total[k].count += region->count;
+			total[k].time_ns += region->time_ns;
+			for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+			{
+				total[k].energy[i] += region->energy[i];
+			}
+		}
+	}
+
+	for (int k = 0; k < nr_total; k++)
+	{
+		double seconds = (double)total[k].time_ns / NSEC_PER_SEC;
+
+		fprintf(f, "region %s: %" PRIu64 " calls, %.6f s\n", total[k].name, total[k].count, seconds);
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			if (region_available[i])
+			{
+				double joules = (double)total[k].energy[i] * region_scale[i];
+				fprintf(f, "\t%-14s %12.6f Joules %10.3f W\n", rapl_domain_names[i], joules,
+						seconds > 0.0 ? joules / seconds : 0.0);
+			}
+		}
+	}
+}
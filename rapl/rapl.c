@@ -19,7 +19,7 @@ perf_event_open() support requires at least Linux 3.14 and to have
 the sysfs powercap interface got into the kernel in
 	2d281d8196e38dd (3.13) */
 
-// Compile with:   gcc -O2 -Wall -o rapl-read rapl-read.c -lm
+// Compile with:   make (builds librapl.a, see rapl.h, and links rapl against it)
 
 // cat /sys/devices/system/cpu/cpu*/topology/physical_package_id
 // cat /proc/sys/kernel/perf_event_paranoid
@@ -29,6 +29,7 @@ the sysfs powercap interface got into the kernel in
 // cat /sys/bus/event_source/devices/power/events/energy-pkg.unit
 
 #include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,64 +41,136 @@ the sysfs powercap interface got into the kernel in
 #include <unistd.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
 
 #include <sys/syscall.h>
+#include <sys/wait.h>
 #include <linux/perf_event.h>
 #include <linux/hw_breakpoint.h>
 
-#define MAX_CPUS 1024
-#define MAX_PACKAGES 16
-#define PID_NEGATIVE_ONE -1
+#include "rapl.h"
+#include "rapl_accumulator.h"
+#include "rapl_backend.h"
+#include "rapl_cap.h"
+#include "rapl_cstate.h"
+#include "rapl_freq.h"
+#include "rapl_sampler.h"
+#include "rapl_shm.h"
+#include "rapl_throttle.h"
+#include "rapl_trace.h"
 
-static int total_cores = 0, total_packages = 0;
-static int package_map[MAX_PACKAGES];
+#define PID_NEGATIVE_ONE -1
+#define ALL_CORES -1
+#define MIN_INTERVAL_MS 1
+#define DEFAULT_INTERVAL_MS 100
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
+#define ALIGN_EDGES 16
+#define DEFAULT_BENCH_READS 10000
+#define DEFAULT_BENCH_INTERVAL_US 1000
+#define DEFAULT_CAP_KP 0.5
+#define DEFAULT_CAP_KI 2.0
+#define DEFAULT_CAP_EPOCH 10
+#define DEFAULT_CAP_STEP_W 2.0
+
+static volatile sig_atomic_t daemon_running = 1;
+
+struct daemon_options
+{
+	int interval_ms;
+	int duration_s;
+	const char *trace;
+	const char *backend;
+	const char *shm;
+	bool align;
+	bool per_core;
+	bool freq;
+	int cpu;
+	int fifo_priority;
+};
 
-static void open_fd(int fd[][MAX_PACKAGES], int pid, int core);
+static void open_fd(int fd[][MAX_PACKAGES], int pid);
 static void close_fd(int fd[][MAX_PACKAGES], int core);
 static void measure_cores(int core);
 static void measure_energy_consumption(int argc, char *argv[]);
 static void detect_cpu();
 static void detect_packages();
-static void reset_package_map();
 static void sleep_experiment(int time);
-static void launch_experiment();
+static int launch_experiment(char *argv[]);
+static void rapl_stat(int argc, char *argv[]);
+static void print_stat(const char *name, const char *units, double *x, int n);
+static void rapl_cap_controller(int argc, char *argv[]);
 static void rapl_perf(pid_t pid, int core);
-static int get_perf_event_rapl_type();
-static int get_perf_event_rapl_config();
-static double get_perf_event_rapl_scale();
-static void get_perf_event_rapl_units(char *);
-
+static void detect_rapl_domains();
+static void read_package(int fd[][MAX_PACKAGES], int j, long long value[NUM_RAPL_DOMAINS]);
+static void *rapl_daemon(void *arg);
+static void start_daemon(struct daemon_options *opt);
+static struct rapl_backend *open_backend(const char *name);
+static void read_backend(struct rapl_backend *b, int j, long long value[NUM_RAPL_DOMAINS]);
+static void rapl_bench(int argc, char *argv[]);
+static void rapl_watch(int argc, char *argv[]);
+static void rapl_throttle_monitor(int argc, char *argv[]);
+static void rapl_cstate_monitor(int argc, char *argv[]);
+static void stop_daemon(int sig);
+static void timespec_add_ns(struct timespec *ts, long ns);
+static double timespec_diff(struct timespec *start, struct timespec *end);
+
+/*
+ * RAPL counters are per package, so every package is measured once over a
+ * single shared window no matter how many cores were asked for. A specific
+ * core only narrows the report down to the package it belongs to.
+ */
 static void measure_cores(int core)
 {
-	if (core != -1)
-	{
-		rapl_perf(PID_NEGATIVE_ONE, core);
-	}
-	else
+	if (core != ALL_CORES && (core < 0 || core >= rapl_total_cores || !rapl_topo.cpus[core].online))
 	{
-		for (int cpu = 0; cpu < total_cores; cpu++)
-		{
-			rapl_perf(PID_NEGATIVE_ONE, cpu);
-		}
+		printf("no such online core %d, detected %d cores\n", core, rapl_total_cores);
+		exit(-1);
 	}
+	rapl_perf(PID_NEGATIVE_ONE, core);
 }
 
 static void sleep_experiment(int time)
 {
 
 	printf("sleeping for %d\n\n", time);
-	sleep(time);
+	rapl_sleep_ns((long long)time * NSEC_PER_SEC);
 }
 
-static void launch_experiment()
+/*
+ * Runs the workload in a child so that rapl is still around to read the
+ * counters once it exits. Returns the child's exit status.
+ */
+static int launch_experiment(char *argv[])
 {
-	printf("launching experiment:\n\n");
-	int result = execvp("./lock", NULL);
+	// don't let the child inherit and replay our buffered output
+	fflush(stdout);
+	pid_t pid = fork();
+
+	if (pid == -1)
+	{
+		printf("couldn't fork experiment: %s\n", strerror(errno));
+		exit(-1);
+	}
 
-	if (result == -1)
+	if (pid == 0)
 	{
-		printf("couldn't launch experiement\n");
+		execvp(argv[0], argv);
+		fprintf(stderr, "couldn't launch experiment %s: %s\n", argv[0], strerror(errno));
+		_exit(127);
 	}
+
+	int status;
+	while (waitpid(pid, &status, 0) == -1)
+	{
+		if (errno != EINTR)
+		{
+			printf("couldn't wait for experiment: %s\n", strerror(errno));
+			exit(-1);
+		}
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
 }
 
 static int open_msr(int core)
@@ -115,279 +188,1388 @@ static int open_msr(int core)
 			fprintf(stderr, "rdmsr: No CPU %d\n", core);
 			exit(2);
 		}
-		else if (errno == EIO)
+		else if (errno == EIO)
+		{
+			fprintf(stderr, "rdmsr: CPU %d doesn't support MSRs\n",
+					core);
+			exit(3);
+		}
+		else
+		{
+			perror("rdmsr:open");
+			fprintf(stderr, "Trying to open %s\n", msr_filename);
+			exit(127);
+		}
+	}
+
+	return fd;
+}
+
+static long long read_msr(int fd, int which)
+{
+	uint64_t data;
+
+	if (pread(fd, &data, sizeof data, which) != sizeof data)
+	{
+		perror("rdmsr:pread");
+		exit(127);
+	}
+	return (long long)data;
+}
+
+static void detect_cpu()
+{
+	char vendor_id[BUFSIZ];
+
+	if (rapl_detect_vendor(vendor_id, sizeof(vendor_id)) != 0)
+	{
+		exit(1);
+	}
+	printf("CPU: %s\n\n", vendor_id);
+}
+
+static void detect_packages()
+{
+	if (rapl_detect_packages() != 0)
+	{
+		exit(-1);
+	}
+
+	for (int i = 0; i < rapl_topo.nr_cpus; i++)
+	{
+		printf("%d (%d)", i, rapl_topo.cpus[i].package_id);
+
+		i % 8 == 7 ? printf("\n") : printf(", ");
+	}
+
+	printf("\n");
+	topology_print(&rapl_topo, stdout);
+	printf("\n");
+}
+
+static void detect_rapl_domains()
+{
+	if (rapl_detect_domains() < 0)
+	{
+		exit(-1);
+	}
+}
+
+static void open_fd(int fd[][MAX_PACKAGES], int pid)
+{
+	if (rapl_open_groups(fd, pid) != 0)
+	{
+		exit(-1);
+	}
+}
+
+static void read_package(int fd[][MAX_PACKAGES], int j, long long value[NUM_RAPL_DOMAINS])
+{
+	if (rapl_read_package(fd, j, value) != 0)
+	{
+		perror("read_package");
+		exit(-1);
+	}
+}
+
+static void close_fd(int fd[][MAX_PACKAGES], int core)
+{
+	long long values[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+
+	// read every package back to back before printing anything
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		read_package(fd, j, values[j]);
+	}
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (core != ALL_CORES && rapl_topo.cpus[core].package != j)
+		{
+			continue;
+		}
+
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			if (fd[i][j] != -1)
+			{
+				printf("[Package: %d] %s consumed: %lf %s\n", j, rapl_domain_names[i],
+					   (double)values[j][i] * rapl_domains[i].scale, rapl_domains[i].units);
+			}
+		}
+	}
+
+	rapl_close_groups(fd);
+}
+
+static void rapl_perf(pid_t pid, int core)
+{
+	int fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
+
+	// measure energy consumption
+	open_fd(fd, pid);
+	sleep_experiment(1);
+	close_fd(fd, core);
+}
+
+static void stop_daemon(int sig)
+{
+	(void)sig;
+	daemon_running = 0;
+}
+
+static void timespec_add_ns(struct timespec *ts, long ns)
+{
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= NSEC_PER_SEC)
+	{
+		ts->tv_nsec -= NSEC_PER_SEC;
+		ts->tv_sec++;
+	}
+	while (ts->tv_nsec < 0)
+	{
+		ts->tv_nsec += NSEC_PER_SEC;
+		ts->tv_sec--;
+	}
+}
+
+static double timespec_diff(struct timespec *start, struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec) +
+		   (double)(end->tv_nsec - start->tv_nsec) / NSEC_PER_SEC;
+}
+
+/*
+ * Keeps the backend open for the whole run and samples every package
+ * every interval_ms on an absolute CLOCK_MONOTONIC deadline, so neither
+ * the setup nor the time spent printing drifts the sample period.
+ * Runs until duration_s elapses (0 = forever) or SIGINT/SIGTERM.
+ *
+ * With align, the thread wakes one update period before the deadline and
+ * takes the sample by polling package 0 until its counter updates; the
+ * next deadline is then counted from that edge. Every window spans whole
+ * counter updates instead of starting and ending at random points inside
+ * one. If the counter doesn't move, sampling falls back to plain deadlines.
+ *
+ * Output is one line per package and domain per sample:
+ *	<unix time> <package> <domain> <energy since last sample in J> <average W>
+ *	<energy since start in J>
+ *
+ * With per_core, backends that count energy per core (the msr backend on
+ * AMD) also get a line per core, with core<id> in the domain column.
+ *
+ * With freq, every online cpu also gets a line per sample with its
+ * effective frequency and busy share over the same window (rapl_freq.h):
+ *	<unix time> <package> cpu<id> <MHz while busy> <busy %> <APERF/MPERF>
+ * so a governor's request can be matched against what the cpu then ran
+ * at and the energy it took.
+ *
+ * With a trace file nothing is formatted while sampling: the raw counters
+ * are appended to a buffered binary trace (see rapl_trace.h) that
+ * rapl-convert turns into CSV or columns afterwards. With freq the trace
+ * gets every cpu's raw APERF and MPERF too.
+ *
+ * With a shared memory name every sample is published there instead of
+ * printed, for any number of local readers (see rapl_shm.h, rapl watch).
+ * Its layout has no room for freq, which needs text or a trace.
+ */
+static void *rapl_daemon(void *arg)
+{
+	const struct daemon_options *opt = arg;
+	struct rapl_trace_writer *w = NULL;
+	struct rapl_shm *shm = NULL;
+	bool text = !opt->trace && !opt->shm;
+	struct rapl_backend *b = open_backend(opt->backend);
+	struct rapl_accumulator acc[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	struct rapl_freq freq;
+	struct rapl_freq_sample fs;
+	struct rapl_freq_cpu fc;
+	long long value[MAX_PACKAGES][NUM_RAPL_DOMAINS], core_value, *core_last = NULL;
+	double energy, total, elapsed;
+	struct timespec start, next, last, now, wall, wake;
+	long interval_ns = opt->interval_ms * NSEC_PER_MSEC;
+	long long period_ns = 0;
+	int edge_domain = 0;
+	bool align = opt->align;
+
+	if (opt->freq && rapl_freq_open(&freq) != 0)
+	{
+		exit(-1);
+	}
+
+	if (opt->trace && !(w = rapl_trace_open(opt->trace, b->scale, opt->freq ? freq.tsc_hz : 0.0)))
+	{
+		exit(-1);
+	}
+
+	if (opt->shm)
+	{
+		if (rapl_shm_create(opt->shm, &shm) != 0)
+		{
+			exit(-1);
+		}
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			shm->available |= b->available[i] ? 1u << i : 0;
+			shm->scale[i] = b->scale[i];
+		}
+	}
+
+	if (opt->per_core && !b->read_core)
+	{
+		printf("the %s backend has no per core energy\n\n", b->name);
+	}
+	else if (opt->per_core)
+	{
+		core_last = calloc(b->nr_cores, sizeof(*core_last));
+		for (int c = 0; c < b->nr_cores; c++)
+		{
+			if (b->read_core(b, c, &core_last[c]) != 0)
+			{
+				perror("read_core");
+				exit(-1);
+			}
+		}
+	}
+
+	while (edge_domain < NUM_RAPL_DOMAINS - 1 && !b->available[edge_domain])
+	{
+		edge_domain++;
+	}
+	if (align && (period_ns = rapl_update_period_ns(b, 0, edge_domain, ALIGN_EDGES)) < 0)
+	{
+		printf("%s doesn't update, sampling without alignment\n\n", rapl_domain_names[edge_domain]);
+		align = false;
+	}
+	else if (align)
+	{
+		printf("%s updates every %.3f ms, sampling on update edges\n\n",
+			   rapl_domain_names[edge_domain], (double)period_ns / NSEC_PER_MSEC);
+	}
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		read_backend(b, j, value[j]);
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			rapl_accumulator_init(&acc[j][i], RAPL_NO_WRAP, value[j][i]);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = last = start;
+
+	if (text)
+	{
+		printf("# time\tpackage\tdomain\tenergy(J)\tpower(W)\ttotal(J)\n");
+	}
+	if (text && opt->freq)
+	{
+		printf("# time\tpackage\tcpu\tfreq(MHz)\tbusy(%%)\tAPERF/MPERF\n");
+	}
+
+	while (daemon_running)
+	{
+		timespec_add_ns(&next, interval_ns);
+		wake = next;
+		if (align)
+		{
+			timespec_add_ns(&wake, -period_ns);
+		}
+		if (rapl_sleep_until(&wake) != 0)
+		{
+			// interrupted by a signal, daemon_running decides if we go on
+			timespec_add_ns(&next, -interval_ns);
+			continue;
+		}
+
+		if (align && rapl_wait_update(b, 0, edge_domain, value[0], &now, 2 * period_ns) == 0)
+		{
+			// count the next window from the edge, not from the deadline
+			next = now;
+		}
+		else
+		{
+			read_backend(b, 0, value[0]);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+		}
+		for (int j = 1; j < rapl_total_packages; j++)
+		{
+			read_backend(b, j, value[j]);
+		}
+		clock_gettime(CLOCK_REALTIME, &wall);
+		elapsed = timespec_diff(&last, &now);
+		last = now;
+
+		if (shm)
+		{
+			rapl_shm_write_begin(shm);
+			shm->sample.time_ns = (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+			shm->sample.samples++;
+		}
+
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+			{
+				if (!b->available[i])
+				{
+					continue;
+				}
+				energy = (double)rapl_accumulator_update(&acc[j][i], value[j][i]) * b->scale[i];
+				total = (double)acc[j][i].total * b->scale[i];
+
+				if (shm)
+				{
+					shm->sample.domain[j][i].count = acc[j][i].total;
+					shm->sample.domain[j][i].joules = total;
+					shm->sample.domain[j][i].watts = energy / elapsed;
+				}
+				if (w && rapl_trace_append(w, (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec, j, i, value[j][i]) != 0)
+				{
+					fprintf(stderr, "could not write trace %s: %s\n", opt->trace, strerror(errno));
+					daemon_running = 0;
+				}
+				if (!text)
+				{
+					continue;
+				}
+
+				printf("%ld.%06ld\t%d\t%s\t%.6f\t%.3f\t%.6f\n",
+					   (long)wall.tv_sec, wall.tv_nsec / 1000, j,
+					   rapl_domain_names[i], energy, energy / elapsed, total);
+			}
+		}
+		if (shm)
+		{
+			rapl_shm_write_end(shm);
+		}
+
+		for (int cpu = 0; core_last && text && cpu < rapl_topo.nr_cpus; cpu++)
+		{
+			struct topology_cpu *t = &rapl_topo.cpus[cpu];
+
+			if (!t->online || t->thread != 0 || b->read_core(b, t->core, &core_value) != 0)
+			{
+				continue;
+			}
+			energy = (double)(core_value - core_last[t->core]) * b->scale[1];
+			core_last[t->core] = core_value;
+
+			printf("%ld.%06ld\t%d\tcore%d\t%.6f\t%.3f\t%.6f\n",
+				   (long)wall.tv_sec, wall.tv_nsec / 1000, t->package, t->core,
+				   energy, energy / elapsed, (double)core_value * b->scale[1]);
+		}
+
+		for (int cpu = 0; opt->freq && w && cpu < rapl_topo.nr_cpus; cpu++)
+		{
+			int package = rapl_topo.cpus[cpu].package;
+
+			if (!rapl_topo.cpus[cpu].online || rapl_freq_read(&freq, cpu, &fc) != 0)
+			{
+				continue;
+			}
+			if (rapl_trace_append_cpu(w, fc.time_ns, package, RAPL_TRACE_APERF, cpu, fc.aperf) != 0 ||
+				rapl_trace_append_cpu(w, fc.time_ns, package, RAPL_TRACE_MPERF, cpu, fc.mperf) != 0)
+			{
+				fprintf(stderr, "could not write trace %s: %s\n", opt->trace, strerror(errno));
+				daemon_running = 0;
+			}
+		}
+
+		for (int cpu = 0; opt->freq && text && cpu < rapl_topo.nr_cpus; cpu++)
+		{
+			if (!rapl_topo.cpus[cpu].online || rapl_freq_sample(&freq, cpu, &fs) != 0)
+			{
+				continue;
+			}
+			printf("%ld.%06ld\t%d\tcpu%d\t%.0f\t%.1f\t%.3f\n",
+				   (long)wall.tv_sec, wall.tv_nsec / 1000, rapl_topo.cpus[cpu].package, cpu,
+				   fs.mhz, fs.busy, fs.ratio);
+		}
+		if (text)
+		{
+			fflush(stdout);
+		}
+
+		if (opt->duration_s > 0 && timespec_diff(&start, &now) >= opt->duration_s)
+		{
+			break;
+		}
+
+		// fell behind by more than one period, skip missed deadlines
+		if (timespec_diff(&next, &now) * NSEC_PER_SEC > interval_ns)
+		{
+			next = now;
+		}
+	}
+
+	b->close(b);
+	free(core_last);
+	if (opt->freq)
+	{
+		rapl_freq_close(&freq);
+	}
+	if (shm)
+	{
+		rapl_shm_destroy(opt->shm, shm);
+	}
+
+	if (w && rapl_trace_close(w) != 0)
+	{
+		fprintf(stderr, "could not write trace %s: %s\n", opt->trace, strerror(errno));
+	}
+
+	return NULL;
+}
+
+/*
+ * Runs the daemon on its own sampler thread, pinned to opt->cpu and
+ * under SCHED_FIFO if asked, while this thread only waits for it.
+ */
+static void start_daemon(struct daemon_options *opt)
+{
+	pthread_t sampler;
+
+	signal(SIGINT, stop_daemon);
+	signal(SIGTERM, stop_daemon);
+
+	if (opt->cpu != RAPL_SAMPLER_ANY_CPU && (opt->cpu < 0 || opt->cpu >= rapl_total_cores || !rapl_topo.cpus[opt->cpu].online))
+	{
+		printf("no such online core %d, detected %d cores\n", opt->cpu, rapl_total_cores);
+		exit(-1);
+	}
+
+	if (rapl_sampler_start(&sampler, opt->cpu, opt->fifo_priority, rapl_daemon, opt) != 0)
+	{
+		exit(-1);
+	}
+	pthread_join(sampler, NULL);
+}
+
+static void print_stat(const char *name, const char *units, double *x, int n)
+{
+	double sum = 0.0, min = x[0], max = x[0], mean, var = 0.0;
+
+	for (int r = 0; r < n; r++)
+	{
+		sum += x[r];
+		min = x[r] < min ? x[r] : min;
+		max = x[r] > max ? x[r] : max;
+	}
+	mean = sum / n;
+
+	for (int r = 0; r < n; r++)
+	{
+		var += (x[r] - mean) * (x[r] - mean);
+	}
+	var = n > 1 ? var / (n - 1) : 0.0;
+
+	printf("%16.6f %-2s %-24s +- %6.2f%%   (stddev %.6f, min %.6f, max %.6f)\n",
+		   mean, units, name, mean != 0.0 ? 100.0 * sqrt(var) / mean : 0.0,
+		   sqrt(var), min, max);
+}
+
+/*
+ * perf-stat style front end: rapl stat [-r runs] [--] command [args...]
+ *
+ * The package groups are opened once and read right before fork() and
+ * right after waitpid() of every run, so the per-run overhead is two
+ * read()s per package. Energy is summed over all packages per domain.
+ */
+static void rapl_stat(int argc, char *argv[])
+{
+	int fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
+	long long before[MAX_PACKAGES][NUM_RAPL_DOMAINS], after[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	double *energy[NUM_RAPL_DOMAINS], *power[NUM_RAPL_DOMAINS], *wall;
+	struct timespec start, end;
+	char name[BUFSIZ];
+	int runs = 1, c, status;
+
+	// '+' stops at the first non-option so the command keeps its own flags
+	while ((c = getopt(argc, argv, "+hr:")) != -1)
+	{
+		switch (c)
+		{
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl stat [-r runs] [--] command [args...]\n");
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (optind >= argc || runs < 1)
+	{
+		printf("Usage: rapl stat [-r runs] [--] command [args...]\n");
+		exit(-1);
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		energy[i] = calloc(runs, sizeof(double));
+		power[i] = calloc(runs, sizeof(double));
+	}
+	wall = calloc(runs, sizeof(double));
+
+	detect_rapl_domains();
+	open_fd(fd, PID_NEGATIVE_ONE);
+
+	for (int r = 0; r < runs; r++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			read_package(fd, j, before[j]);
+		}
+
+		status = launch_experiment(&argv[optind]);
+
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			read_package(fd, j, after[j]);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (status != 0)
+		{
+			printf("%s exited with status %d in run %d\n", argv[optind], status, r + 1);
+		}
+
+		wall[r] = timespec_diff(&start, &end);
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			for (int j = 0; j < rapl_total_packages; j++)
+			{
+				energy[i][r] += (double)(after[j][i] - before[j][i]) * rapl_domains[i].scale;
+			}
+			power[i][r] = energy[i][r] / wall[r];
+		}
+	}
+
+	printf("\n Energy stats for '");
+	for (int a = optind; a < argc; a++)
+	{
+		printf(a + 1 < argc ? "%s " : "%s", argv[a]);
+	}
+	printf("' (%d run%s):\n\n", runs, runs > 1 ? "s" : "");
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		if (rapl_domains[i].available)
+		{
+			print_stat(rapl_domain_names[i], "J", energy[i], runs);
+		}
+	}
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		if (rapl_domains[i].available)
+		{
+			sprintf(name, "%s avg power", rapl_domain_names[i]);
+			print_stat(name, "W", power[i], runs);
+		}
+	}
+	print_stat("time elapsed", "s", wall, runs);
+	printf("\n");
+
+	rapl_close_groups(fd);
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		free(energy[i]);
+		free(power[i]);
+	}
+	free(wall);
+}
+
+/*
+ * Opens the named backend, or with no name the one rapl_backend_select()
+ * finds cheapest to read on this machine.
+ */
+static struct rapl_backend *open_backend(const char *name)
+{
+	struct rapl_backend *b;
+
+	if (!name)
+	{
+		if (!(b = rapl_backend_select()))
+		{
+			printf("no rapl backend could be opened\n");
+			exit(-1);
+		}
+		printf("Using the %s backend\n\n", b->name);
+		return b;
+	}
+
+	if (!(b = rapl_backend_find(name)))
+	{
+		printf("Unknown backend %s, use perf, msr, sysfs or snapshot\n", name);
+		exit(-1);
+	}
+	if (b->open(b) != 0)
+	{
+		printf("could not open the %s backend\n", name);
+		exit(-1);
+	}
+
+	return b;
+}
+
+static void read_backend(struct rapl_backend *b, int j, long long value[NUM_RAPL_DOMAINS])
+{
+	if (b->read(b, j, value) != 0)
+	{
+		perror("read_backend");
+		exit(-1);
+	}
+}
+
+/*
+ * rapl bench [-n reads] [-i us] [-b backend]
+ *
+ * Benchmarks every backend that opens (or just the one given): read
+ * latency percentiles, CPU time per read and how late reads scheduled on
+ * an absolute interval grid complete.
+ */
+static void rapl_bench(int argc, char *argv[])
+{
+	struct rapl_bench res;
+	const char *only = NULL;
+	int reads = DEFAULT_BENCH_READS, interval_us = DEFAULT_BENCH_INTERVAL_US, c;
+
+	while ((c = getopt(argc, argv, "b:hi:n:")) != -1)
+	{
+		switch (c)
+		{
+		case 'b':
+			only = optarg;
+			break;
+		case 'i':
+			interval_us = atoi(optarg);
+			break;
+		case 'n':
+			reads = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl bench [-n reads] [-i us] [-b perf|msr|sysfs|snapshot]\n");
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (reads < 1 || interval_us < 0)
+	{
+		printf("Usage: rapl bench [-n reads] [-i us] [-b perf|msr|sysfs|snapshot]\n");
+		exit(-1);
+	}
+
+	printf("%d reads of %d package%s per backend, jitter at %d us intervals\n\n",
+		   reads, rapl_total_packages, rapl_total_packages > 1 ? "s" : "", interval_us);
+	printf("%-8s %10s %10s %10s %10s %10s %10s %12s %12s %12s\n", "backend",
+		   "p50(ns)", "p90(ns)", "p99(ns)", "max(ns)", "user(ns)", "sys(ns)",
+		   "late(ns)", "stddev(ns)", "maxlate(ns)");
+
+	for (int k = 0; k < RAPL_NR_BACKENDS; k++)
+	{
+		struct rapl_backend *b = &rapl_backends[k];
+
+		if (only && strcmp(only, b->name))
+		{
+			continue;
+		}
+		if (b->open(b) != 0)
+		{
+			printf("%-8s unavailable\n", b->name);
+			continue;
+		}
+		if (rapl_backend_bench(b, reads, interval_us, &res) != 0)
+		{
+			printf("%-8s read failed: %s\n", b->name, strerror(errno));
+		}
+		else
+		{
+			printf("%-8s %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %12.0f %12.0f %12.0f\n", b->name,
+				   res.p50_ns, res.p90_ns, res.p99_ns, res.max_ns, res.user_ns, res.sys_ns,
+				   res.jitter_mean_ns, res.jitter_stddev_ns, res.jitter_max_ns);
+		}
+		b->close(b);
+	}
+	printf("\n");
+}
+
+/*
+ * rapl watch [-S name] [-i ms]
+ *
+ * Prints what a daemon started with -S publishes, reading the segment
+ * without system calls. Mostly an example of a shared memory reader.
+ */
+static void rapl_watch(int argc, char *argv[])
+{
+	const struct rapl_shm *shm;
+	struct rapl_shm_sample sample;
+	const char *name = RAPL_SHM_NAME;
+	uint64_t seen = 0;
+	int interval_ms = DEFAULT_INTERVAL_MS, c;
+
+	while ((c = getopt(argc, argv, "hi:S:")) != -1)
+	{
+		switch (c)
+		{
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'S':
+			name = optarg;
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl watch [-S shm] [-i ms]\n");
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (rapl_shm_attach(name, &shm) != 0)
+	{
+		exit(-1);
+	}
+
+	signal(SIGINT, stop_daemon);
+	signal(SIGTERM, stop_daemon);
+
+	printf("# sample\tpackage\tdomain\tpower(W)\ttotal(J)\n");
+	while (daemon_running)
+	{
+		rapl_shm_read(shm, &sample);
+		if (sample.samples != seen)
+		{
+			seen = sample.samples;
+			for (uint32_t j = 0; j < shm->nr_packages; j++)
+			{
+				for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+				{
+					if (shm->available & (1u << i))
+					{
+						printf("%" PRIu64 "\t%u\t%s\t%.3f\t%.6f\n", sample.samples, j,
+							   shm->domain_names[i], sample.domain[j][i].watts, sample.domain[j][i].joules);
+					}
+				}
+			}
+			fflush(stdout);
+		}
+		rapl_sleep_ns((long long)interval_ms * NSEC_PER_MSEC);
+	}
+}
+
+static void print_reasons(uint32_t reasons)
+{
+	const char *sep = "";
+
+	for (int r = 0; r < RAPL_NR_THROTTLE_REASONS; r++)
+	{
+		if (reasons & (1u << r))
+		{
+			printf("%s%s", sep, rapl_throttle_reason_names[r]);
+			sep = ",";
+		}
+	}
+	printf("%s", *sep ? "" : "-");
+}
+
+/*
+ * rapl throttle [-i ms] [-t s]
+ *
+ * Prints, per package and interval, the percentage of the interval each
+ * RAPL domain spent throttled and why. A line starting with '#' marks
+ * the sample where throttling of a package begins or ends, so slowdowns
+ * can be lined up with power or thermal limits afterwards.
+ */
+static void rapl_throttle_monitor(int argc, char *argv[])
+{
+	struct rapl_throttle t;
+	struct rapl_throttle_sample s;
+	struct timespec start, next, last, now, wall;
+	struct timespec began[MAX_PACKAGES];
+	bool throttled[MAX_PACKAGES] = {false}, active;
+	int interval_ms = DEFAULT_INTERVAL_MS, duration_s = 0, c;
+	long interval_ns;
+	double elapsed;
+
+	while ((c = getopt(argc, argv, "hi:t:")) != -1)
+	{
+		switch (c)
+		{
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 't':
+			duration_s = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl throttle [-i ms] [-t s]\n");
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (interval_ms < MIN_INTERVAL_MS)
+	{
+		printf("interval must be at least %d ms\n", MIN_INTERVAL_MS);
+		exit(-1);
+	}
+	if (rapl_throttle_open(&t) != 0)
+	{
+		exit(-1);
+	}
+	if (!t.writable)
+	{
+		printf("msr is read only, logged reasons stay set once seen\n");
+	}
+
+	signal(SIGINT, stop_daemon);
+	signal(SIGTERM, stop_daemon);
+
+	interval_ns = interval_ms * NSEC_PER_MSEC;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = last = start;
+
+	printf("# time\tpackage");
+	for (int d = 0; d < RAPL_NR_THROTTLE_DOMAINS; d++)
+	{
+		if (t.available[d])
+		{
+			printf("\t%s(%%)", rapl_throttle_domain_names[d]);
+		}
+	}
+	printf("\treasons\n");
+
+	while (daemon_running)
+	{
+		timespec_add_ns(&next, interval_ns);
+		if (rapl_sleep_until(&next) != 0)
+		{
+			timespec_add_ns(&next, -interval_ns);
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		clock_gettime(CLOCK_REALTIME, &wall);
+		elapsed = timespec_diff(&last, &now);
+		last = now;
+
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			if (rapl_throttle_sample(&t, j, &s) != 0)
+			{
+				perror("rapl_throttle_sample");
+				exit(-1);
+			}
+
+			active = s.reasons != 0;
+			printf("%ld.%06ld\t%d", (long)wall.tv_sec, wall.tv_nsec / 1000, j);
+			for (int d = 0; d < RAPL_NR_THROTTLE_DOMAINS; d++)
+			{
+				if (t.available[d])
+				{
+					printf("\t%.2f", 100.0 * s.throttled_s[d] / elapsed);
+					active = active || s.throttled_s[d] > 0.0;
+				}
+			}
+			printf("\t");
+			print_reasons(s.reasons);
+			printf("\n");
+
+			if (active && !throttled[j])
+			{
+				printf("# %ld.%06ld package %d throttling began: ", (long)wall.tv_sec, wall.tv_nsec / 1000, j);
+				print_reasons(s.reasons);
+				printf("\n");
+				began[j] = now;
+			}
+			else if (!active && throttled[j])
+			{
+				printf("# %ld.%06ld package %d throttling ended after %.3f s\n",
+					   (long)wall.tv_sec, wall.tv_nsec / 1000, j, timespec_diff(&began[j], &now));
+			}
+			throttled[j] = active;
+		}
+		fflush(stdout);
+
+		if (duration_s > 0 && timespec_diff(&start, &now) >= duration_s)
 		{
-			fprintf(stderr, "rdmsr: CPU %d doesn't support MSRs\n",
-					core);
-			exit(3);
+			break;
 		}
-		else
+		if (timespec_diff(&next, &now) * NSEC_PER_SEC > interval_ns)
 		{
-			perror("rdmsr:open");
-			fprintf(stderr, "Trying to open %s\n", msr_filename);
-			exit(127);
+			next = now;
 		}
 	}
 
-	return fd;
+	rapl_throttle_close(&t);
 }
 
-static long long read_msr(int fd, int which)
+/*
+ * Requests a PM QoS cpu latency cap by writing it to /dev/cpu_dma_latency;
+ * the kernel holds it for as long as the file stays open. Returns the fd.
+ */
+static int hold_latency(int32_t latency_us)
 {
-	uint64_t data;
+	int fd = open("/dev/cpu_dma_latency", O_RDWR);
 
-	if (pread(fd, &data, sizeof data, which) != sizeof data)
+	if (fd < 0 || write(fd, &latency_us, sizeof(latency_us)) != sizeof(latency_us))
 	{
-		perror("rdmsr:pread");
-		exit(127);
+		printf("could not set /dev/cpu_dma_latency: %s\n", strerror(errno));
+		exit(-1);
 	}
-	return (long long)data;
+
+	return fd;
 }
 
-static void detect_cpu()
+/*
+ * rapl cstate [-i ms] [-t s] [-l us] [-b backend]
+ *
+ * Prints, per package and interval, the package power next to the
+ * residency of each package and core C-state and of each cpuidle state,
+ * plus how often cpus entered the cpuidle states (see rapl_cstate.h).
+ * With -l the monitor holds a PM QoS latency cap of us microseconds for
+ * its whole run, so runs with and without a cap give what it costs in
+ * energy.
+ */
+static void rapl_cstate_monitor(int argc, char *argv[])
 {
-	FILE *f = fopen("/proc/cpuinfo", "r");
+	struct rapl_cstate cs;
+	struct rapl_cstate_sample s;
+	struct rapl_backend *b;
+	struct rapl_accumulator acc[MAX_PACKAGES];
+	struct timespec start, next, last, now, wall;
+	long long value[NUM_RAPL_DOMAINS];
+	const char *backend = NULL;
+	int interval_ms = DEFAULT_INTERVAL_MS, duration_s = 0, latency_us = -1, qos_fd = -1, c;
+	int32_t current;
+	long interval_ns;
+	double elapsed;
+
+	while ((c = getopt(argc, argv, "b:hi:l:t:")) != -1)
+	{
+		switch (c)
+		{
+		case 'b':
+			backend = optarg;
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'l':
+			latency_us = atoi(optarg);
+			break;
+		case 't':
+			duration_s = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl cstate [-i ms] [-t s] [-l us] [-b backend]\n");
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
 
-	if (!f)
+	if (interval_ms < MIN_INTERVAL_MS)
 	{
-		printf("could not open /proc/cpuinfo\n");
-		exit(1);
+		printf("interval must be at least %d ms\n", MIN_INTERVAL_MS);
+		exit(-1);
+	}
+	if (latency_us >= 0)
+	{
+		qos_fd = hold_latency(latency_us);
+	}
+	if (rapl_cstate_open(&cs) != 0)
+	{
+		exit(-1);
+	}
+	b = open_backend(backend);
+	if (!b->available[0])
+	{
+		printf("the %s backend has no %s, power is left out\n\n", b->name, rapl_domain_names[0]);
 	}
 
-	char buffer[BUFSIZ], vendor_id[BUFSIZ], *result;
-	while (true)
+	// the aggregate cap all requests on the system resolve to
+	if ((c = open("/dev/cpu_dma_latency", O_RDONLY)) >= 0)
 	{
-		result = fgets(buffer, BUFSIZ, f);
-		if (!result)
+		if (read(c, &current, sizeof(current)) == sizeof(current))
 		{
-			break;
+			printf("# cpu_dma_latency %d us\n", current);
 		}
+		close(c);
+	}
+
+	signal(SIGINT, stop_daemon);
+	signal(SIGTERM, stop_daemon);
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		read_backend(b, j, value);
+		rapl_accumulator_init(&acc[j], RAPL_NO_WRAP, value[0]);
+	}
 
-		if (!strncmp(result, "vendor_id", 8))
+	printf("# time\tpackage\tpower(W)");
+	for (int i = 0; i < RAPL_NR_PKG_CSTATES; i++)
+	{
+		if (cs.pkg_available[i])
 		{
-			sscanf(result, "%*s%*s%s", vendor_id);
-			printf("CPU: %s\n\n", vendor_id);
-			break;
+			printf("\t%s(%%)", rapl_cstate_pkg_names[i]);
 		}
 	}
-	fclose(f);
-}
-
-static void reset_package_map()
-{
-	for (int i = 0; i < MAX_PACKAGES; i++)
+	for (int i = 0; i < RAPL_NR_CORE_CSTATES; i++)
+	{
+		if (cs.core_available[i])
+		{
+			printf("\t%s(%%)", rapl_cstate_core_names[i]);
+		}
+	}
+	for (int k = 0; k < cs.nr_idle_states; k++)
 	{
-		package_map[i] = -1;
+		printf("\t%s(%%)\t%s(/s)", cs.idle_names[k], cs.idle_names[k]);
 	}
-}
-static void detect_packages()
-{
-	reset_package_map();
+	printf("\n");
 
-	char filename[BUFSIZ];
-	FILE *f;
-	int i, package;
+	interval_ns = interval_ms * NSEC_PER_MSEC;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = last = start;
 
-	for (i = 0; i < MAX_CPUS; i++)
+	while (daemon_running)
 	{
-		sprintf(filename, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
-		f = fopen(filename, "r");
-		if (!f)
+		timespec_add_ns(&next, interval_ns);
+		if (rapl_sleep_until(&next) != 0)
 		{
-			break;
+			timespec_add_ns(&next, -interval_ns);
+			continue;
 		}
 
-		fscanf(f, "%d", &package);
-		printf("%d (%d)", i, package);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		clock_gettime(CLOCK_REALTIME, &wall);
+		elapsed = timespec_diff(&last, &now);
+		last = now;
 
-		i % 8 == 7 ? printf("\n") : printf(", ");
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			read_backend(b, j, value);
+			if (rapl_cstate_sample(&cs, j, &s) != 0)
+			{
+				perror("rapl_cstate_sample");
+				exit(-1);
+			}
 
-		fclose(f);
+			printf("%ld.%06ld\t%d", (long)wall.tv_sec, wall.tv_nsec / 1000, j);
+			if (b->available[0])
+			{
+				printf("\t%.3f", (double)rapl_accumulator_update(&acc[j], value[0]) * b->scale[0] / elapsed);
+			}
+			else
+			{
+				printf("\t-");
+			}
+			for (int i = 0; i < RAPL_NR_PKG_CSTATES; i++)
+			{
+				if (cs.pkg_available[i])
+				{
+					printf("\t%.2f", s.pkg[i]);
+				}
+			}
+			for (int i = 0; i < RAPL_NR_CORE_CSTATES; i++)
+			{
+				if (cs.core_available[i])
+				{
+					printf("\t%.2f", s.core[i]);
+				}
+			}
+			for (int k = 0; k < cs.nr_idle_states; k++)
+			{
+				printf("\t%.2f\t%.0f", s.idle[k], s.entries[k]);
+			}
+			printf("\n");
+		}
+		fflush(stdout);
 
-		if (package_map[package] == -1)
+		if (duration_s > 0 && timespec_diff(&start, &now) >= duration_s)
+		{
+			break;
+		}
+		if (timespec_diff(&next, &now) * NSEC_PER_SEC > interval_ns)
 		{
-			total_packages++;
-			package_map[package] = i;
+			next = now;
 		}
 	}
 
-	total_cores = i;
-	printf("Detected %d cores in %d packages\n\n", total_cores, total_packages);
+	b->close(b);
+	rapl_cstate_close(&cs);
+	if (qos_fd >= 0)
+	{
+		close(qos_fd);
+	}
 }
 
-static int perf_event_open(struct perf_event_attr *hw_event_uptr, pid_t pid, int cpu, int group_fd, unsigned long flags)
+static int read_work_counter(const char *path, double *work)
 {
-	return syscall(__NR_perf_event_open, hw_event_uptr, pid, cpu, group_fd, flags);
-}
-
-#define NUM_RAPL_DOMAINS 1
-
-char rapl_domain_names[NUM_RAPL_DOMAINS][30] = {
-	"energy-pkg",
-};
+	FILE *f = fopen(path, "r");
+	int ret;
 
-static int check_paranoid(void)
-{
-	int paranoid_value;
-	FILE *f = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
 	if (!f)
 	{
-		fprintf(stderr, "Error! could not open /proc/sys/kernel/perf_event_paranoid %s\n", strerror(errno));
-		// return non-negative paranoid value, since negative means no paranoia
-		return 404;
+		return -1;
 	}
-	fscanf(f, "%d", &paranoid_value);
+	ret = fscanf(f, "%lf", work) == 1 ? 0 : -1;
 	fclose(f);
 
-	return paranoid_value;
+	return ret;
 }
 
-static int get_perf_event_rapl_type()
+/*
+ * Power capping controller: rapl cap -w watts [options]
+ *
+ * Splits the power budget evenly over the packages and runs a PI loop per
+ * package that moves PL1 so that the measured energy-pkg power settles on
+ * that share. PL2 follows PL1 with the PL2/PL1 ratio found at start. The
+ * integral stops growing while the limit is clamped, so that a long stretch
+ * of a workload drawing less than its target doesn't wind it up.
+ *
+ * With -m the target itself is searched for: the file must hold a number
+ * the workload keeps increasing (requests, iterations, bytes...), and every
+ * epoch the target is stepped in whichever direction last improved work
+ * per Joule, never above the budget share.
+ *
+ * The limits found at start are restored on exit, including SIGINT/SIGTERM.
+ */
+static void rapl_cap_controller(int argc, char *argv[])
 {
-	FILE *f = fopen("/sys/bus/event_source/devices/power/type", "r");
-	if (!f)
+	int fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
+	struct rapl_cap caps[MAX_PACKAGES];
+	long long value[NUM_RAPL_DOMAINS], last[MAX_PACKAGES];
+	double target[MAX_PACKAGES], integral[MAX_PACKAGES], limit[MAX_PACKAGES], ratio[MAX_PACKAGES];
+	double budget = 0.0, kp = DEFAULT_CAP_KP, ki = DEFAULT_CAP_KI, step = DEFAULT_CAP_STEP_W;
+	double work = 0.0, last_work = 0.0, epoch_energy = 0.0, efficiency, last_efficiency = 0.0;
+	double power, error, elapsed, dir = -1.0, lo, hi;
+	int interval_ms = DEFAULT_INTERVAL_MS, duration_s = 0, epoch = DEFAULT_CAP_EPOCH, samples = 0, c;
+	const char *metric = NULL;
+	struct timespec start, next, prev, now;
+	long interval_ns;
+	int ret = 0;
+
+	while ((c = getopt(argc, argv, "+e:hi:I:m:p:s:t:w:")) != -1)
 	{
-		printf("could not retrieve perf_event_rapl type\n");
-		exit(-1);
+		switch (c)
+		{
+		case 'e':
+			epoch = atoi(optarg);
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'I':
+			ki = atof(optarg);
+			break;
+		case 'm':
+			metric = optarg;
+			break;
+		case 'p':
+			kp = atof(optarg);
+			break;
+		case 's':
+			step = atof(optarg);
+			break;
+		case 't':
+			duration_s = atoi(optarg);
+			break;
+		case 'w':
+			budget = atof(optarg);
+			break;
+		case 'h':
+		default:
+			printf("Usage: rapl cap -w watts [-i ms] [-t s] [-p kp] [-I ki] [-m file [-e samples] [-s watts]]\n\n");
+			printf("\t-w watts   : package power budget, split evenly over the packages\n");
+			printf("\t-i ms      : control interval (default: %d)\n", DEFAULT_INTERVAL_MS);
+			printf("\t-t s       : stop after s seconds and restore the limits (default: until SIGINT)\n");
+			printf("\t-p kp      : proportional gain, W of limit per W of error (default: %g)\n", DEFAULT_CAP_KP);
+			printf("\t-I ki      : integral gain, per second (default: %g)\n", DEFAULT_CAP_KI);
+			printf("\t-m file    : maximize the rate of the counter in file per Joule\n");
+			printf("\t-e samples : with -m, samples per search step (default: %d)\n", DEFAULT_CAP_EPOCH);
+			printf("\t-s watts   : with -m, search step (default: %g)\n", DEFAULT_CAP_STEP_W);
+			exit(c == 'h' ? 0 : -1);
+		}
 	}
-	int type = 0;
-	fscanf(f, "%d", &type);
-	fclose(f);
 
-	return type;
-}
-
-static int get_perf_event_rapl_config()
-{
-	char *filename = "/sys/bus/event_source/devices/power/events/energy-pkg";
-	FILE *f = fopen(filename, "r");
-	if (!f)
+	if (budget <= 0.0 || interval_ms < MIN_INTERVAL_MS || epoch < 1)
 	{
-		printf("could not retrieve perf_event_rapl config\n");
+		printf("Usage: rapl cap -w watts [-i ms] [-t s] [-p kp] [-I ki] [-m file [-e samples] [-s watts]]\n");
+		exit(-1);
+	}
+	if (metric && read_work_counter(metric, &last_work) != 0)
+	{
+		printf("could not read a number from %s\n", metric);
 		exit(-1);
 	}
-	int config = 0;
-	fscanf(f, "event = %x", &config);
-	fclose(f);
-
-	return config;
-}
 
-static double get_perf_event_rapl_scale()
-{
-	char *filename = "/sys/bus/event_source/devices/power/events/energy-pkg.scale";
-	FILE *f = fopen(filename, "r");
-	if (!f)
+	detect_rapl_domains();
+	if (!rapl_domains[0].available)
 	{
-		printf("could not retrieve perf_event_rapl scale\n");
+		printf("%s is needed to control package power\n", rapl_domain_names[0]);
 		exit(-1);
 	}
-	double scale = 0.0;
-	fscanf(f, "%lf", &scale);
-	fclose(f);
 
-	return scale;
-}
+	// from here on every way out goes through restore
+	signal(SIGINT, stop_daemon);
+	signal(SIGTERM, stop_daemon);
 
-static void get_perf_event_rapl_units(char *units)
-{
-	char *filename = "/sys/bus/event_source/devices/power/events/energy-pkg.unit";
-	FILE *f = fopen(filename, "r");
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (rapl_cap_open(&caps[j], j) != 0)
+		{
+			while (j--)
+			{
+				rapl_cap_close(&caps[j]);
+			}
+			exit(-1);
+		}
+		target[j] = limit[j] = budget / rapl_total_packages;
+		integral[j] = 0.0;
+		ratio[j] = caps[j].saved_pl1 > 0.0 && caps[j].saved_pl2 > caps[j].saved_pl1 ? caps[j].saved_pl2 / caps[j].saved_pl1 : 1.0;
+		printf("[Package: %d] %s limits PL1 %.3f W PL2 %.3f W\n", j,
+			   caps[j].backend == RAPL_CAP_POWERCAP ? "powercap" : "msr", caps[j].saved_pl1, caps[j].saved_pl2);
+	}
 
-	if (!f)
+	if (rapl_open_groups(fd, PID_NEGATIVE_ONE) != 0)
 	{
-		printf("could not retrieve perf_event rapl units\n");
-		exit(-1);
+		ret = -1;
+		goto restore;
+	}
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (rapl_read_package(fd, j, value) != 0)
+		{
+			perror("read_package");
+			ret = -1;
+			goto close;
+		}
+		last[j] = value[0];
+		rapl_cap_set(&caps[j], limit[j], limit[j] * ratio[j]);
 	}
-	fscanf(f, "%s", units);
-	fclose(f);
-}
 
-static void open_fd(int fd[][MAX_PACKAGES], int pid, int core)
-{
-	int type = get_perf_event_rapl_type();
-	int config = get_perf_event_rapl_config();
-	int paranoid = check_paranoid();
-	struct perf_event_attr attr;
+	interval_ns = interval_ms * NSEC_PER_MSEC;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = prev = start;
+
+	printf("# time\tpackage\ttarget(W)\tpower(W)\tPL1(W)%s\n", metric ? "\twork/J" : "");
 
-	for (int j = 0; j < total_packages; j++)
+	while (daemon_running)
 	{
-		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		timespec_add_ns(&next, interval_ns);
+		if (rapl_sleep_until(&next) != 0)
 		{
-			fd[i][j] = -1;
-			memset(&attr, 0x0, sizeof(attr));
-			attr.type = type;
-			attr.config = config;
-			// int perf_event_open(struct perf_event_attr *attr,
-			//                     pid_t pid, int cpu, int group_fd,
-			//                     unsigned long flags);
-			// fd[i][j] = perf_event_open(&attr, -1, package_map[j], -1, 0);
+			// interrupted by a signal, daemon_running decides if we go on
+			timespec_add_ns(&next, -interval_ns);
+			continue;
+		}
 
-			fd[i][j] = perf_event_open(&attr, pid, core, -1, 0);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = timespec_diff(&prev, &now);
+		prev = now;
 
-			if (fd[i][j] < 0)
+		for (int j = 0; j < rapl_total_packages; j++)
+		{
+			if (rapl_read_package(fd, j, value) != 0)
 			{
-				if (errno == EACCES)
-				{
-					printf("\n\tNeed root privileges or perf_event_paranoid < 0\n\n");
-					paranoid = check_paranoid();
+				perror("read_package");
+				ret = -1;
+				goto close;
+			}
+			power = (double)(value[0] - last[j]) * rapl_domains[0].scale / elapsed;
+			epoch_energy += (double)(value[0] - last[j]) * rapl_domains[0].scale;
+			last[j] = value[0];
 
-					if (paranoid > 0)
-					{
-						printf("\t/proc/sys/kernel/perf_event_paranoid is %d\n", paranoid);
-					}
-					exit(-1);
+			lo = caps[j].min_power > 0.0 ? caps[j].min_power : 1.0;
+			hi = caps[j].max_power > 0.0 ? caps[j].max_power : budget;
+
+			error = target[j] - power;
+			integral[j] += error * elapsed;
+			limit[j] = target[j] + kp * error + ki * integral[j];
+			if (limit[j] < lo || limit[j] > hi)
+			{
+				// anti-windup: drop this step's contribution while saturated
+				integral[j] -= error * elapsed;
+				limit[j] = limit[j] < lo ? lo : hi;
+			}
+
+			if (rapl_cap_set(&caps[j], limit[j], limit[j] * ratio[j]) != 0)
+			{
+				daemon_running = 0;
+			}
+
+			printf("%.3f\t%d\t%.3f\t%.3f\t%.3f", timespec_diff(&start, &now), j, target[j], power, limit[j]);
+			printf(metric ? "\t%.6f\n" : "\n", last_efficiency);
+		}
+		fflush(stdout);
+
+		if (metric && ++samples == epoch)
+		{
+			// perturb and observe: keep going while work per Joule improves
+			if (read_work_counter(metric, &work) == 0 && epoch_energy > 0.0)
+			{
+				efficiency = (work - last_work) / epoch_energy;
+				if (efficiency < last_efficiency)
+				{
+					dir = -dir;
 				}
-				else
+				last_efficiency = efficiency;
+				last_work = work;
+
+				for (int j = 0; j < rapl_total_packages; j++)
 				{
-					printf("\terror opening core %d config %d: %s\n\n", package_map[j], config, strerror(errno));
-					exit(-1);
+					lo = caps[j].min_power > 0.0 ? caps[j].min_power : 1.0;
+					target[j] += dir * step;
+					target[j] = target[j] < lo ? lo : target[j];
+					target[j] = target[j] > budget / rapl_total_packages ? budget / rapl_total_packages : target[j];
+					integral[j] = 0.0;
 				}
 			}
+			samples = 0;
+			epoch_energy = 0.0;
 		}
-	}
-}
-
-static void close_fd(int fd[][MAX_PACKAGES], int core)
-{
-	double scale = get_perf_event_rapl_scale();
 
-	char units[BUFSIZ];
-	get_perf_event_rapl_units(units);
+		if (duration_s > 0 && timespec_diff(&start, &now) >= duration_s)
+		{
+			break;
+		}
+		if (timespec_diff(&next, &now) * NSEC_PER_SEC > interval_ns)
+		{
+			next = now;
+		}
+	}
 
-	long long value;
-	for (int j = 0; j < total_packages; j++)
+close:
+	rapl_close_groups(fd);
+restore:
+	for (int j = 0; j < rapl_total_packages; j++)
 	{
-		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		if (rapl_cap_close(&caps[j]) == 0)
 		{
-			if (fd[i][j] != -1)
-			{
-				read(fd[i][j], &value, 8);
-				close(fd[i][j]);
-				printf("[CPU: %d] energy consumed: %lf %s\n", core, (double)value * scale, units);
-			}
+			printf("[Package: %d] restored PL1 %.3f W PL2 %.3f W\n", j, caps[j].saved_pl1, caps[j].saved_pl2);
 		}
 	}
-}
-
-static void rapl_perf(pid_t pid, int core)
-{
-	int fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
-
-	// measure energy consumption
-	open_fd(fd, pid, core);
-	sleep_experiment(1);
-	close_fd(fd, core);
+	if (ret != 0)
+	{
+		exit(-1);
+	}
 }
 
 static int rapl_sysfs(int core)
 {
 	char event_names[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
 	char filenames[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
+	char rangefiles[MAX_PACKAGES][NUM_RAPL_DOMAINS][256];
 	char basename[MAX_PACKAGES][256];
 	char tempfile[256];
 	long long before[MAX_PACKAGES][NUM_RAPL_DOMAINS];
 	long long after[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	long long range[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	struct rapl_accumulator acc;
 	int valid[MAX_PACKAGES][NUM_RAPL_DOMAINS];
 	int i, j;
 	FILE *fff;
@@ -399,7 +1581,7 @@ static int rapl_sysfs(int core)
 	/* energy_uj has energy */
 	/* subdirectories intel-rapl:0:0 intel-rapl:0:1 intel-rapl:0:2 */
 
-	for (j = 0; j < total_packages; j++)
+	for (j = 0; j < rapl_total_packages; j++)
 	{
 		i = 0;
 		sprintf(basename[j], "/sys/class/powercap/intel-rapl/intel-rapl:%d",
@@ -415,6 +1597,7 @@ static int rapl_sysfs(int core)
 		valid[j][i] = 1;
 		fclose(fff);
 		sprintf(filenames[j][i], "%s/energy_uj", basename[j]);
+		sprintf(rangefiles[j][i], "%s/max_energy_range_uj", basename[j]);
 
 		/* Handle subdomains */
 		for (i = 1; i < NUM_RAPL_DOMAINS; i++)
@@ -433,11 +1616,31 @@ static int rapl_sysfs(int core)
 			fclose(fff);
 			sprintf(filenames[j][i], "%s/intel-rapl:%d:%d/energy_uj",
 					basename[j], j, i - 1);
+			sprintf(rangefiles[j][i], "%s/intel-rapl:%d:%d/max_energy_range_uj",
+					basename[j], j, i - 1);
+		}
+	}
+
+	/* energy_uj wraps back to 0 once it reaches max_energy_range_uj */
+	for (j = 0; j < rapl_total_packages; j++)
+	{
+		for (i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			range[j][i] = RAPL_NO_WRAP;
+			if (valid[j][i])
+			{
+				fff = fopen(rangefiles[j][i], "r");
+				if (fff != NULL)
+				{
+					fscanf(fff, "%lld", &range[j][i]);
+					fclose(fff);
+				}
+			}
 		}
 	}
 
 	/* Gather before values */
-	for (j = 0; j < total_packages; j++)
+	for (j = 0; j < rapl_total_packages; j++)
 	{
 		for (i = 0; i < NUM_RAPL_DOMAINS; i++)
 		{
@@ -458,10 +1661,10 @@ static int rapl_sysfs(int core)
 	}
 
 	printf("\tSleeping 1 second\n\n");
-	sleep(1);
+	rapl_sleep_ns(NSEC_PER_SEC);
 
 	/* Gather after values */
-	for (j = 0; j < total_packages; j++)
+	for (j = 0; j < rapl_total_packages; j++)
 	{
 		for (i = 0; i < NUM_RAPL_DOMAINS; i++)
 		{
@@ -481,15 +1684,17 @@ static int rapl_sysfs(int core)
 		}
 	}
 
-	for (j = 0; j < total_packages; j++)
+	for (j = 0; j < rapl_total_packages; j++)
 	{
 		printf("\tPackage %d\n", j);
 		for (i = 0; i < NUM_RAPL_DOMAINS; i++)
 		{
 			if (valid[j][i])
 			{
+				rapl_accumulator_init(&acc, range[j][i], before[j][i]);
+				rapl_accumulator_update(&acc, after[j][i]);
 				printf("\t\t%s\t: %lfJ\n", event_names[j][i],
-					   ((double)after[j][i] - (double)before[j][i]) / 1000000.0);
+					   (double)acc.total / 1000000.0);
 			}
 		}
 	}
@@ -502,7 +1707,36 @@ int main(int argc, char **argv)
 {
 	detect_cpu();
 	detect_packages();
-	measure_energy_consumption(argc, argv);
+
+	if (argc > 1 && !strcmp(argv[1], "stat"))
+	{
+		rapl_stat(argc - 1, argv + 1);
+	}
+	else if (argc > 1 && !strcmp(argv[1], "bench"))
+	{
+		rapl_bench(argc - 1, argv + 1);
+	}
+	else if (argc > 1 && !strcmp(argv[1], "watch"))
+	{
+		rapl_watch(argc - 1, argv + 1);
+	}
+	else if (argc > 1 && !strcmp(argv[1], "throttle"))
+	{
+		rapl_throttle_monitor(argc - 1, argv + 1);
+	}
+	else if (argc > 1 && !strcmp(argv[1], "cstate"))
+	{
+		rapl_cstate_monitor(argc - 1, argv + 1);
+	}
+	else if (argc > 1 && !strcmp(argv[1], "cap"))
+	{
+		rapl_cap_controller(argc - 1, argv + 1);
+	}
+	else
+	{
+		measure_energy_consumption(argc, argv);
+	}
+	topology_free(&rapl_topo);
 
 	return 0;
 }
@@ -510,24 +1744,115 @@ int main(int argc, char **argv)
 void measure_energy_consumption(int argc, char *argv[])
 {
 	int c;
-	int core = atoi(argv[2]);
-
-	while ((c = getopt(argc, argv, "c:hmps")) != -1)
+	int core = ALL_CORES;
+	struct daemon_options opt = {
+		.interval_ms = DEFAULT_INTERVAL_MS,
+		.cpu = RAPL_SAMPLER_ANY_CPU,
+		.fifo_priority = RAPL_SAMPLER_NO_FIFO,
+	};
+	char mode = 0;
+
+	while ((c = getopt(argc, argv, "ab:Cc:dfF:hi:mo:P:pS:st:")) != -1)
 	{
 		switch (c)
 		{
+		case 'C':
+			opt.per_core = true;
+			break;
+		case 'f':
+			opt.freq = true;
+			break;
+		case 'a':
+			opt.align = true;
+			break;
+		case 'b':
+			opt.backend = optarg;
+			break;
+		case 'F':
+			opt.fifo_priority = atoi(optarg);
+			break;
+		case 'P':
+			opt.cpu = atoi(optarg);
+			break;
+		case 'S':
+			opt.shm = optarg;
+			break;
+		case 'c':
+			core = atoi(optarg);
+			break;
 		case 'h':
-			printf("Usage: %s [-h] [-s|p] n [core]\n\n", argv[0]);
+			printf("Usage: %s [-h] [-s|-p [-c core]|-d [-i ms] [-t s] [-o trace] [-S shm] [-b backend] [-a] [-C] [-f] [-P cpu] [-F prio]]\n", argv[0]);
+			printf("       %s stat [-r runs] [--] command [args...]\n", argv[0]);
+			printf("       %s bench [-n reads] [-i us] [-b backend]\n", argv[0]);
+			printf("       %s watch [-S shm] [-i ms]\n", argv[0]);
+			printf("       %s throttle [-i ms] [-t s]\n", argv[0]);
+			printf("       %s cstate [-i ms] [-t s] [-l us] [-b backend]\n", argv[0]);
+			printf("       %s cap -w watts [-i ms] [-t s] [-m file], see %s cap -h\n\n", argv[0], argv[0]);
+			printf("\t-a      : daemon samples right after the counters update, see rapl_sampler.h\n");
+			printf("\t-b name : daemon reads through perf, msr, sysfs or snapshot (default: fastest, see %s bench)\n", argv[0]);
+			printf("\t-C      : daemon also reports energy per core (AMD Zen, msr backend)\n");
+			printf("\t-c core : with -p, report only the package of core (default: all)\n");
+			printf("\t-d      : daemon mode, sample all packages continuously\n");
+			printf("\t-f      : daemon also reports effective frequency and busy %% per cpu (APERF/MPERF), in text or -o\n");
+			printf("\t-i ms   : daemon sample interval (default: %d, min: %d)\n",
+				   DEFAULT_INTERVAL_MS, MIN_INTERVAL_MS);
+			printf("\t-t s    : stop the daemon after s seconds (default: run until SIGINT)\n");
+			printf("\t-P cpu  : pin the daemon's sampler thread to cpu\n");
+			printf("\t-F prio : run the daemon's sampler thread SCHED_FIFO at prio (1-99)\n");
+			printf("\t-o file : daemon writes a binary trace to file instead of text, see rapl-convert\n");
+			printf("\t-S name : daemon publishes to shared memory name (e.g. %s) instead of text\n", RAPL_SHM_NAME);
+			printf("\t-p      : one-shot perf_event measurement\n");
+			printf("\t-s      : one-shot sysfs measurement\n");
 			exit(0);
+		case 'i':
+			opt.interval_ms = atoi(optarg);
+			break;
+		case 't':
+			opt.duration_s = atoi(optarg);
+			break;
+		case 'o':
+			opt.trace = optarg;
+			break;
+		case 'd':
 		case 'p':
-			measure_cores(core);
-			exit(0);
 		case 's':
-			rapl_sysfs(0);
-			exit(0);
+			mode = c;
+			break;
 		default:
 			fprintf(stderr, "Unknown option %c\n", c);
 			exit(-1);
 		}
 	}
+
+	switch (mode)
+	{
+	case 'd':
+		if (opt.interval_ms < MIN_INTERVAL_MS)
+		{
+			fprintf(stderr, "interval must be at least %d ms\n", MIN_INTERVAL_MS);
+			exit(-1);
+		}
+		if (opt.freq && opt.shm && !opt.trace)
+		{
+			fprintf(stderr, "-f is recorded in text or a trace (-o), not in shared memory\n");
+			exit(-1);
+		}
+		// only the msr backend sees Zen's per core counters
+		if (opt.per_core && !opt.backend && rapl_vendor == RAPL_VENDOR_AMD)
+		{
+			opt.backend = "msr";
+		}
+		start_daemon(&opt);
+		break;
+	case 'p':
+		detect_rapl_domains();
+		measure_cores(core);
+		break;
+	case 's':
+		rapl_sysfs(0);
+		break;
+	default:
+		fprintf(stderr, "No mode given, see %s -h\n", argv[0]);
+		exit(-1);
+	}
 }
\ No newline at end of file
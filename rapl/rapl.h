@@ -0,0 +1,79 @@
+/* librapl -- RAPL energy counters through perf_event
+
+Package and domain detection, perf event groups and the in-process region
+API used by the rapl tool and by programs that want to know what a phase
+of their own code costs in energy.
+
+Link with librapl.a (built by the Makefile in this directory), e.g.
+	gcc -I../rapl -I../topology -o prog prog.c ../rapl/librapl.a -lm
+
+Instrumenting a phase:
+
+	rapl_init();
+	rapl_region_begin("merge");
+	merge_sections_of_array(...);
+	rapl_region_end("merge");
+	rapl_region_report(stdout);
+	rapl_finish();
+
+Region names are compared by pointer first, so pass the same string
+literal to begin and end. If rapl_init() fails, e.g. for lack of
+permissions, the region calls do nothing.
+
+With comm/rapl_snapshot.ko loaded, begin and end copy the counters out of
+its mapping, which costs well under a microsecond but gives counts up to
+the module's interval_us old; a region longer than one wrap of the 32 bit
+counters (minutes at full power) is undercounted. Without it they fall
+back to a perf group read() per package, a syscall of a few microseconds. */
+
+#ifndef _RAPL_H
+#define _RAPL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "topology.h"
+
+#define MAX_PACKAGES 16
+#define NUM_RAPL_DOMAINS 5
+#define RAPL_MAX_REGIONS 64
+
+enum rapl_vendor
+{
+	RAPL_VENDOR_UNKNOWN,
+	RAPL_VENDOR_INTEL,
+	RAPL_VENDOR_AMD, // AMD and Hygon, Zen and later
+};
+
+struct rapl_domain
+{
+	bool available;
+	int config;
+	double scale;
+	char units[BUFSIZ];
+};
+
+extern char rapl_domain_names[NUM_RAPL_DOMAINS][30];
+extern struct rapl_domain rapl_domains[NUM_RAPL_DOMAINS];
+
+extern enum rapl_vendor rapl_vendor;
+extern int rapl_cpu_family, rapl_cpu_model; // from /proc/cpuinfo, -1 if not found
+extern int rapl_total_cores, rapl_total_packages;
+extern int rapl_package_map[MAX_PACKAGES];
+extern struct topology rapl_topo;
+
+int rapl_detect_vendor(char *vendor_id, size_t len);
+int rapl_detect_packages(void);
+int rapl_detect_domains(void);
+int rapl_open_groups(int fd[][MAX_PACKAGES], pid_t pid);
+int rapl_read_package(int fd[][MAX_PACKAGES], int j, long long value[NUM_RAPL_DOMAINS]);
+void rapl_close_groups(int fd[][MAX_PACKAGES]);
+
+int rapl_init(void);
+void rapl_finish(void);
+void rapl_region_begin(const char *name);
+void rapl_region_end(const char *name);
+void rapl_region_report(FILE *f);
+
+#endif
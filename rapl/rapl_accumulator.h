@@ -0,0 +1,68 @@
+/* Wraparound-safe 64-bit energy accumulation for RAPL counters
+
+The raw energy counters are narrower than the totals we want to keep:
+	MSR_*_ENERGY_STATUS is 32 bits wide and wraps in about a minute on
+	a busy server, and powercap's energy_uj wraps at max_energy_range_uj.
+	perf_event already hands out 64-bit counts, so it uses a range of 0.
+
+An accumulator remembers the last raw reading and folds every new one in
+as a forward delta, so one wrap between two samples is corrected. Sample
+at least once per wrap period; more often gains nothing. */
+
+#ifndef _RAPL_ACCUMULATOR_H
+#define _RAPL_ACCUMULATOR_H
+
+#include <stdint.h>
+
+// 32-bit MSR energy counters
+#define RAPL_MSR_ENERGY_RANGE (1ULL << 32)
+// counters that never wrap, e.g. perf_event
+#define RAPL_NO_WRAP 0
+
+struct rapl_accumulator
+{
+	uint64_t range; // raw value wraps to 0 when reaching range, 0 = never
+	uint64_t last;	// last raw reading
+	uint64_t total; // raw units accumulated since rapl_accumulator_init()
+	uint64_t wraps; // number of wraps corrected
+};
+
+static inline void rapl_accumulator_init(struct rapl_accumulator *acc, uint64_t range, uint64_t raw)
+{
+	acc->range = range;
+	acc->last = raw;
+	acc->total = 0;
+	acc->wraps = 0;
+}
+
+/*
+ * Folds a new raw reading into the total and returns the raw delta since
+ * the previous one. A reading below the previous one means the counter
+ * wrapped, unless the counter has no range, in which case it went
+ * backwards (e.g. a perf counter reset) and the delta is 0.
+ */
+static inline uint64_t rapl_accumulator_update(struct rapl_accumulator *acc, uint64_t raw)
+{
+	uint64_t delta;
+
+	if (raw >= acc->last)
+	{
+		delta = raw - acc->last;
+	}
+	else if (acc->range)
+	{
+		delta = acc->range - acc->last + raw;
+		acc->wraps++;
+	}
+	else
+	{
+		delta = 0;
+	}
+
+	acc->last = raw;
+	acc->total += delta;
+
+	return delta;
+}
+
+#endif
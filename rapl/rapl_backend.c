@@ -0,0 +1,764 @@
+/* librapl access backends -- see rapl_backend.h */
+
+#define _GNU_SOURCE // RUSAGE_THREAD
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "rapl.h"
+#include "rapl_backend.h"
+
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_USEC 1000L
+#define SELECT_READS 200
+
+#define MSR_RAPL_POWER_UNIT 0x606
+#define MSR_PKG_ENERGY_STATUS 0x611
+#define MSR_DRAM_ENERGY_STATUS 0x619
+#define MSR_PP0_ENERGY_STATUS 0x639
+#define MSR_PP1_ENERGY_STATUS 0x641
+#define MSR_PLATFORM_ENERGY_STATUS 0x64d
+#define ENERGY_STATUS_MASK 0xffffffffULL
+
+#define MSR_AMD_RAPL_POWER_UNIT 0xc0010299
+#define MSR_AMD_CORE_ENERGY_STATUS 0xc001029a
+#define MSR_AMD_PKG_ENERGY_STATUS 0xc001029b
+
+#define POWERCAP_DIR "/sys/class/powercap"
+
+// in rapl_domain_names order
+static const int msr_intel_energy_status[NUM_RAPL_DOMAINS] = {
+	MSR_PKG_ENERGY_STATUS,
+	MSR_PP0_ENERGY_STATUS,
+	MSR_DRAM_ENERGY_STATUS,
+	MSR_PP1_ENERGY_STATUS,
+	MSR_PLATFORM_ENERGY_STATUS,
+};
+
+// powercap zone names in rapl_domain_names order, the package zone is package-N
+static const char *powercap_zone_names[NUM_RAPL_DOMAINS] = {
+	NULL,
+	"core",
+	"dram",
+	"uncore",
+	"psys",
+};
+
+static void reset_fds(struct rapl_backend *b)
+{
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		b->available[i] = false;
+		b->scale[i] = 0.0;
+		for (int j = 0; j < MAX_PACKAGES; j++)
+		{
+			b->fd[i][j] = -1;
+		}
+	}
+}
+
+static void close_fds(struct rapl_backend *b)
+{
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		for (int j = 0; j < MAX_PACKAGES; j++)
+		{
+			if (b->fd[i][j] != -1)
+			{
+				close(b->fd[i][j]);
+			}
+		}
+	}
+	reset_fds(b);
+}
+
+static int perf_open(struct rapl_backend *b)
+{
+	reset_fds(b);
+
+	if (rapl_detect_domains() < 0 || rapl_open_groups(b->fd, -1) != 0)
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		b->available[i] = rapl_domains[i].available;
+		b->scale[i] = rapl_domains[i].scale;
+	}
+
+	return 0;
+}
+
+static int perf_read(struct rapl_backend *b, int package, long long value[NUM_RAPL_DOMAINS])
+{
+	return rapl_read_package(b->fd, package, value);
+}
+
+static void perf_close(struct rapl_backend *b)
+{
+	rapl_close_groups(b->fd);
+	reset_fds(b);
+}
+
+static int read_msr(int fd, int which, uint64_t *data)
+{
+	return pread(fd, data, sizeof(*data), which) == sizeof(*data) ? 0 : -1;
+}
+
+static void msr_close(struct rapl_backend *b)
+{
+	for (int c = 0; c < b->nr_cores && b->core_fd; c++)
+	{
+		if (b->core_fd[c] != -1)
+		{
+			close(b->core_fd[c]);
+		}
+	}
+	free(b->core_fd);
+	free(b->core_acc);
+	b->core_fd = NULL;
+	b->core_acc = NULL;
+	b->nr_cores = 0;
+	b->read_core = NULL;
+
+	close_fds(b);
+}
+
+static int amd_read_core(struct rapl_backend *b, int core, long long *value)
+{
+	uint64_t raw;
+
+	if (read_msr(b->core_fd[core], MSR_AMD_CORE_ENERGY_STATUS, &raw) != 0)
+	{
+		return -1;
+	}
+	rapl_accumulator_update(&b->core_acc[core], raw & ENERGY_STATUS_MASK);
+	*value = (long long)b->core_acc[core].total;
+
+	return 0;
+}
+
+/*
+ * Zen counts energy per core, in the core's own msr, with no package
+ * wide PP0 equivalent. Opens the msr of the first online thread of every
+ * core so amd_read_core() can read each one, and energy-cores of a
+ * package becomes the sum of its cores.
+ */
+static int amd_open_cores(struct rapl_backend *b)
+{
+	char filename[BUFSIZ];
+	uint64_t raw;
+
+	b->nr_cores = rapl_topo.nr_cores;
+	b->core_fd = malloc(b->nr_cores * sizeof(*b->core_fd));
+	b->core_acc = calloc(b->nr_cores, sizeof(*b->core_acc));
+	if (!b->core_fd || !b->core_acc)
+	{
+		return -1;
+	}
+	for (int c = 0; c < b->nr_cores; c++)
+	{
+		b->core_fd[c] = -1;
+	}
+
+	for (int cpu = 0; cpu < rapl_topo.nr_cpus; cpu++)
+	{
+		int c = rapl_topo.cpus[cpu].core;
+
+		if (!rapl_topo.cpus[cpu].online || b->core_fd[c] != -1)
+		{
+			continue;
+		}
+		snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", cpu);
+		if ((b->core_fd[c] = open(filename, O_RDONLY)) < 0 ||
+			read_msr(b->core_fd[c], MSR_AMD_CORE_ENERGY_STATUS, &raw) != 0)
+		{
+			return -1;
+		}
+		rapl_accumulator_init(&b->core_acc[c], RAPL_MSR_ENERGY_RANGE, raw & ENERGY_STATUS_MASK);
+	}
+
+	b->read_core = amd_read_core;
+	return 0;
+}
+
+/*
+ * Joules per count of domain i given MSR_RAPL_POWER_UNIT. Intel server
+ * parts count DRAM in a fixed 2^-16 J (15.3 uJ) whatever the register
+ * says, see rapl-original/rapl-read.c and the kernel's intel_rapl.
+ */
+static double msr_energy_unit(int i, uint64_t units)
+{
+	static const int fixed_dram_unit_models[] = {
+		63,	 // Haswell-EP
+		79,	 // Broadwell-EP
+		85,	 // Skylake-SP, Cascade Lake, Cooper Lake
+		87,	 // Knights Landing
+		106, // Ice Lake-SP
+		108, // Ice Lake-D
+		133, // Knights Mill
+		143, // Sapphire Rapids
+		207, // Emerald Rapids
+	};
+
+	if (i == 2 && rapl_vendor == RAPL_VENDOR_INTEL && rapl_cpu_family == 6)
+	{
+		for (size_t k = 0; k < sizeof(fixed_dram_unit_models) / sizeof(fixed_dram_unit_models[0]); k++)
+		{
+			if (rapl_cpu_model == fixed_dram_unit_models[k])
+			{
+				return pow(0.5, 16.0);
+			}
+		}
+	}
+
+	return pow(0.5, (double)((units >> 8) & 0x1f));
+}
+
+/* status register of domain i, -1 if the vendor has none */
+static int msr_energy_status(int i)
+{
+	if (rapl_vendor == RAPL_VENDOR_AMD)
+	{
+		return i == 0 ? MSR_AMD_PKG_ENERGY_STATUS : -1;
+	}
+	return msr_intel_energy_status[i];
+}
+
+/*
+ * One msr fd per package, kept in fd[0][j]. A domain is available if its
+ * status register can be read on every package. The 32 bit counters are
+ * folded into the accumulators, so they must be read more often than they
+ * wrap (about a minute at 100 W).
+ */
+static int msr_open(struct rapl_backend *b)
+{
+	char filename[BUFSIZ];
+	uint64_t units, raw;
+	int reg;
+
+	reset_fds(b);
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", rapl_package_map[j]);
+		if ((b->fd[0][j] = open(filename, O_RDONLY)) < 0)
+		{
+			close_fds(b);
+			return -1;
+		}
+	}
+
+	reg = rapl_vendor == RAPL_VENDOR_AMD ? MSR_AMD_RAPL_POWER_UNIT : MSR_RAPL_POWER_UNIT;
+	if (read_msr(b->fd[0][0], reg, &units) != 0)
+	{
+		close_fds(b);
+		return -1;
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		reg = msr_energy_status(i);
+		b->available[i] = reg != -1;
+		for (int j = 0; j < rapl_total_packages && b->available[i]; j++)
+		{
+			b->available[i] = read_msr(b->fd[0][j], reg, &raw) == 0;
+			rapl_accumulator_init(&b->acc[j][i], RAPL_MSR_ENERGY_RANGE, raw & ENERGY_STATUS_MASK);
+		}
+		b->scale[i] = b->available[i] ? msr_energy_unit(i, units) : 0.0;
+	}
+
+	if (rapl_vendor == RAPL_VENDOR_AMD)
+	{
+		if (amd_open_cores(b) != 0)
+		{
+			msr_close(b);
+			return -1;
+		}
+		b->available[1] = true;
+		b->scale[1] = b->scale[0];
+	}
+
+	return b->available[0] ? 0 : -1;
+}
+
+static int msr_read(struct rapl_backend *b, int package, long long value[NUM_RAPL_DOMAINS])
+{
+	long long core;
+	uint64_t raw;
+	int reg;
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		value[i] = 0;
+		if (!b->available[i] || (reg = msr_energy_status(i)) == -1)
+		{
+			continue;
+		}
+		if (read_msr(b->fd[0][package], reg, &raw) != 0)
+		{
+			return -1;
+		}
+		rapl_accumulator_update(&b->acc[package][i], raw & ENERGY_STATUS_MASK);
+		value[i] = (long long)b->acc[package][i].total;
+	}
+
+	// energy-cores from the per core counters
+	for (int cpu = 0; b->read_core && cpu < rapl_topo.nr_cpus; cpu++)
+	{
+		struct topology_cpu *t = &rapl_topo.cpus[cpu];
+
+		if (!t->online || t->package != package || t->thread != 0)
+		{
+			continue;
+		}
+		if (b->read_core(b, t->core, &core) != 0)
+		{
+			return -1;
+		}
+		value[1] += core;
+	}
+
+	return 0;
+}
+
+static int read_sysfs_value(int fd, long long *value)
+{
+	char buffer[64];
+	ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+
+	if (n <= 0)
+	{
+		return -1;
+	}
+	buffer[n] = '\0';
+	*value = strtoll(buffer, NULL, 10);
+
+	return 0;
+}
+
+static int read_sysfs_file(const char *path, char *buffer)
+{
+	FILE *f = fopen(path, "r");
+	int ret;
+
+	if (!f)
+	{
+		return -1;
+	}
+	ret = fscanf(f, "%s", buffer) == 1 ? 0 : -1;
+	fclose(f);
+
+	return ret;
+}
+
+/* opens energy_uj of zone for domain i of package j and sets up its wrap range */
+static int sysfs_open_zone(struct rapl_backend *b, const char *zone, int i, int j)
+{
+	char filename[BUFSIZ];
+	long long range = RAPL_NO_WRAP, value;
+	int fd;
+
+	snprintf(filename, sizeof(filename), "%s/max_energy_range_uj", zone);
+	if ((fd = open(filename, O_RDONLY)) >= 0)
+	{
+		read_sysfs_value(fd, &range);
+		close(fd);
+	}
+
+	snprintf(filename, sizeof(filename), "%s/energy_uj", zone);
+	if ((fd = open(filename, O_RDONLY)) < 0 || read_sysfs_value(fd, &value) != 0)
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return -1;
+	}
+
+	b->fd[i][j] = fd;
+	// max_energy_range_uj is the largest value, the counter wraps after it
+	rapl_accumulator_init(&b->acc[j][i], range == RAPL_NO_WRAP ? RAPL_NO_WRAP : range + 1, value);
+
+	return 0;
+}
+
+/*
+ * Keeps every energy_uj file open and re-reads it with pread() at offset
+ * 0, which makes sysfs regenerate the value without another open().
+ */
+static int sysfs_open(struct rapl_backend *b)
+{
+	char zone[BUFSIZ], sub[BUFSIZ * 2], filename[BUFSIZ * 3], name[BUFSIZ];
+
+	reset_fds(b);
+
+	for (int n = 0; n < 2 * MAX_PACKAGES; n++)
+	{
+		int j = -1, package_id;
+
+		snprintf(zone, sizeof(zone), POWERCAP_DIR "/intel-rapl:%d", n);
+		snprintf(filename, sizeof(filename), "%s/name", zone);
+		if (read_sysfs_file(filename, name) != 0)
+		{
+			continue;
+		}
+
+		// psys sits next to the packages and is counted as package 0's
+		if (!strcmp(name, powercap_zone_names[4]))
+		{
+			sysfs_open_zone(b, zone, 4, 0);
+			continue;
+		}
+		if (sscanf(name, "package-%d", &package_id) != 1)
+		{
+			continue;
+		}
+		for (int k = 0; k < rapl_total_packages; k++)
+		{
+			j = rapl_topo.cpus[rapl_package_map[k]].package_id == package_id ? k : j;
+		}
+		if (j == -1 || sysfs_open_zone(b, zone, 0, j) != 0)
+		{
+			continue;
+		}
+
+		for (int m = 0; m < NUM_RAPL_DOMAINS; m++)
+		{
+			snprintf(sub, sizeof(sub), "%s/intel-rapl:%d:%d", zone, n, m);
+			snprintf(filename, sizeof(filename), "%s/name", sub);
+			if (read_sysfs_file(filename, name) != 0)
+			{
+				break;
+			}
+			for (int i = 1; i < NUM_RAPL_DOMAINS - 1; i++)
+			{
+				if (!strcmp(name, powercap_zone_names[i]))
+				{
+					sysfs_open_zone(b, sub, i, j);
+				}
+			}
+		}
+	}
+
+	// a domain counts if every package has it, psys only needs package 0
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		b->available[i] = rapl_total_packages > 0;
+		for (int j = 0; j < (i == 4 ? 1 : rapl_total_packages); j++)
+		{
+			b->available[i] = b->available[i] && b->fd[i][j] != -1;
+		}
+		b->scale[i] = b->available[i] ? 1e-6 : 0.0;
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		if (b->available[i])
+		{
+			return 0;
+		}
+	}
+	close_fds(b);
+
+	return -1;
+}
+
+static int sysfs_read(struct rapl_backend *b, int package, long long value[NUM_RAPL_DOMAINS])
+{
+	long long raw;
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		value[i] = 0;
+		if (!b->available[i] || b->fd[i][package] == -1)
+		{
+			continue;
+		}
+		if (read_sysfs_value(b->fd[i][package], &raw) != 0)
+		{
+			return -1;
+		}
+		rapl_accumulator_update(&b->acc[package][i], raw);
+		value[i] = (long long)b->acc[package][i].total;
+	}
+
+	return 0;
+}
+
+static void sysfs_close(struct rapl_backend *b)
+{
+	close_fds(b);
+}
+
+/*
+ * Maps /dev/rapl_snapshot from comm/rapl_snapshot.ko. A read is a copy
+ * out of shared memory; the module's per-cpu timers did the MSR reads.
+ * The data is as old as the module's interval_us at most.
+ */
+static int snapshot_open(struct rapl_backend *b)
+{
+	const struct rapl_snapshot *s;
+	struct rapl_snapshot_package p;
+	int fd;
+
+	reset_fds(b);
+
+	if ((fd = open("/dev/" RAPL_SNAPSHOT_DEVICE, O_RDONLY)) < 0)
+	{
+		return -1;
+	}
+	s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED)
+	{
+		return -1;
+	}
+	if (s->magic != RAPL_SNAPSHOT_MAGIC || s->version != RAPL_SNAPSHOT_VERSION ||
+		(int)s->nr_packages != rapl_total_packages || !s->available)
+	{
+		munmap((void *)s, sizeof(*s));
+		return -1;
+	}
+	b->snapshot = s;
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		b->available[i] = s->available & (1u << i);
+		b->scale[i] = b->available[i] ? msr_energy_unit(i, s->power_unit) : 0.0;
+	}
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		rapl_snapshot_read_package(s, j, &p);
+		for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+		{
+			rapl_accumulator_init(&b->acc[j][i], RAPL_MSR_ENERGY_RANGE, p.energy[i]);
+		}
+	}
+
+	return 0;
+}
+
+static int snapshot_read(struct rapl_backend *b, int package, long long value[NUM_RAPL_DOMAINS])
+{
+	struct rapl_snapshot_package p;
+
+	rapl_snapshot_read_package(b->snapshot, package, &p);
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		value[i] = 0;
+		if (b->available[i])
+		{
+			rapl_accumulator_update(&b->acc[package][i], p.energy[i]);
+			value[i] = (long long)b->acc[package][i].total;
+		}
+	}
+
+	return 0;
+}
+
+static void snapshot_close(struct rapl_backend *b)
+{
+	if (b->snapshot)
+	{
+		munmap((void *)b->snapshot, sizeof(*b->snapshot));
+		b->snapshot = NULL;
+	}
+	reset_fds(b);
+}
+
+struct rapl_backend rapl_backends[RAPL_NR_BACKENDS] = {
+	[RAPL_BACKEND_PERF] = {"perf", perf_open, perf_read, perf_close},
+	[RAPL_BACKEND_MSR] = {"msr", msr_open, msr_read, msr_close},
+	[RAPL_BACKEND_SYSFS] = {"sysfs", sysfs_open, sysfs_read, sysfs_close},
+	[RAPL_BACKEND_SNAPSHOT] = {"snapshot", snapshot_open, snapshot_read, snapshot_close},
+};
+
+struct rapl_backend *rapl_backend_find(const char *name)
+{
+	for (int k = 0; k < RAPL_NR_BACKENDS; k++)
+	{
+		if (!strcmp(rapl_backends[k].name, name))
+		{
+			return &rapl_backends[k];
+		}
+	}
+
+	return NULL;
+}
+
+int rapl_backend_read_all(struct rapl_backend *b, long long value[][NUM_RAPL_DOMAINS])
+{
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (b->read(b, j, value[j]) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int64_t rusage_ns(struct timeval *tv)
+{
+	return (int64_t)tv->tv_sec * NSEC_PER_SEC + (int64_t)tv->tv_usec * NSEC_PER_USEC;
+}
+
+static int compare_ns(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile(const int64_t *sorted, int n, double p)
+{
+	return (double)sorted[(int)(p * (n - 1))];
+}
+
+/*
+ * Benchmarks an open backend. Three measurements:
+ *  - latency: reads of every package back to back, each one timed
+ *  - CPU time: user and system time of this thread over those reads
+ *  - jitter (if interval_us > 0): reads on an absolute interval_us grid,
+ *    recording how late each read completes relative to its deadline
+ */
+int rapl_backend_bench(struct rapl_backend *b, int reads, int interval_us, struct rapl_bench *res)
+{
+	long long value[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	int64_t *lat = calloc(reads, sizeof(*lat));
+	struct rusage before, after;
+	struct timespec next;
+	int64_t start;
+	double sum = 0.0, sq = 0.0;
+
+	if (!lat)
+	{
+		return -1;
+	}
+	memset(res, 0, sizeof(*res));
+	res->reads = reads;
+
+	getrusage(RUSAGE_THREAD, &before);
+	for (int n = 0; n < reads; n++)
+	{
+		start = now_ns();
+		if (rapl_backend_read_all(b, value) != 0)
+		{
+			free(lat);
+			return -1;
+		}
+		lat[n] = now_ns() - start;
+	}
+	getrusage(RUSAGE_THREAD, &after);
+
+	res->user_ns = (double)(rusage_ns(&after.ru_utime) - rusage_ns(&before.ru_utime)) / reads;
+	res->sys_ns = (double)(rusage_ns(&after.ru_stime) - rusage_ns(&before.ru_stime)) / reads;
+
+	qsort(lat, reads, sizeof(*lat), compare_ns);
+	res->p50_ns = percentile(lat, reads, 0.50);
+	res->p90_ns = percentile(lat, reads, 0.90);
+	res->p99_ns = percentile(lat, reads, 0.99);
+	res->max_ns = (double)lat[reads - 1];
+
+	if (interval_us <= 0)
+	{
+		free(lat);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (int n = 0; n < reads; n++)
+	{
+		next.tv_nsec += interval_us * NSEC_PER_USEC;
+		while (next.tv_nsec >= NSEC_PER_SEC)
+		{
+			next.tv_nsec -= NSEC_PER_SEC;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+		{
+		}
+		if (rapl_backend_read_all(b, value) != 0)
+		{
+			free(lat);
+			return -1;
+		}
+		lat[n] = now_ns() - ((int64_t)next.tv_sec * NSEC_PER_SEC + next.tv_nsec);
+	}
+
+	for (int n = 0; n < reads; n++)
+	{
+		sum += (double)lat[n];
+		sq += (double)lat[n] * (double)lat[n];
+		res->jitter_max_ns = (double)lat[n] > res->jitter_max_ns ? (double)lat[n] : res->jitter_max_ns;
+	}
+	res->jitter_mean_ns = sum / reads;
+	res->jitter_stddev_ns = sqrt(fmax(sq / reads - res->jitter_mean_ns * res->jitter_mean_ns, 0.0));
+
+	free(lat);
+	return 0;
+}
+
+/*
+ * Opens every backend, times SELECT_READS reads of each and leaves the
+ * one with the lowest median latency open. The energy-pkg domain is
+ * preferred: a backend that lacks it is only chosen if none has it.
+ */
+struct rapl_backend *rapl_backend_select(void)
+{
+	struct rapl_backend *best = NULL;
+	struct rapl_bench res;
+	double best_ns = 0.0;
+
+	for (int k = 0; k < RAPL_NR_BACKENDS; k++)
+	{
+		struct rapl_backend *b = &rapl_backends[k];
+
+		if (b->open(b) != 0)
+		{
+			continue;
+		}
+		if (rapl_backend_bench(b, SELECT_READS, 0, &res) != 0)
+		{
+			b->close(b);
+			continue;
+		}
+
+		if (!best || (b->available[0] && !best->available[0]) ||
+			(b->available[0] == best->available[0] && res.p50_ns < best_ns))
+		{
+			if (best)
+			{
+				best->close(best);
+			}
+			best = b;
+			best_ns = res.p50_ns;
+		}
+		else
+		{
+			b->close(b);
+		}
+	}
+
+	return best;
+}
@@ -0,0 +1,70 @@
+/* RAPL access backends
+
+The same package energy counters can be read four ways: perf_event
+groups, the MSRs through /dev/cpu/N/msr, powercap sysfs energy_uj files,
+or the page the comm/rapl_snapshot module keeps up to date. Every
+backend returns per domain counts that only ever grow (MSR and sysfs
+wraps are folded into 64 bits) together with the scale that turns them
+into Joules, so callers can switch between them freely.
+
+rapl_backend_bench() measures what a read costs on this machine and
+rapl_backend_select() uses it to pick the cheapest backend available. */
+
+#ifndef _RAPL_BACKEND_H
+#define _RAPL_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rapl.h"
+#include "rapl_accumulator.h"
+#include "user-kernel.h"
+
+enum rapl_backend_id
+{
+	RAPL_BACKEND_PERF,
+	RAPL_BACKEND_MSR,
+	RAPL_BACKEND_SYSFS,
+	RAPL_BACKEND_SNAPSHOT,
+	RAPL_NR_BACKENDS,
+};
+
+struct rapl_backend
+{
+	const char *name;
+	int (*open)(struct rapl_backend *b);
+	int (*read)(struct rapl_backend *b, int package, long long value[NUM_RAPL_DOMAINS]);
+	void (*close)(struct rapl_backend *b);
+
+	bool available[NUM_RAPL_DOMAINS];
+	double scale[NUM_RAPL_DOMAINS]; // counts to Joules
+
+	// per core energy, only AMD's msrs have it. NULL read_core otherwise.
+	int (*read_core)(struct rapl_backend *b, int core, long long *value);
+	int nr_cores; // indexed by topology core id
+
+	// backend private state
+	int fd[NUM_RAPL_DOMAINS][MAX_PACKAGES];
+	struct rapl_accumulator acc[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+	int *core_fd;
+	struct rapl_accumulator *core_acc;
+	const struct rapl_snapshot *snapshot;
+};
+
+struct rapl_bench
+{
+	int reads;
+	double p50_ns, p90_ns, p99_ns, max_ns; // latency of one read of every package
+	double user_ns, sys_ns;				   // CPU time per read
+	double jitter_mean_ns, jitter_stddev_ns, jitter_max_ns; // lateness of periodic reads
+};
+
+extern struct rapl_backend rapl_backends[RAPL_NR_BACKENDS];
+
+struct rapl_backend *rapl_backend_find(const char *name);
+int rapl_backend_read_all(struct rapl_backend *b, long long value[][NUM_RAPL_DOMAINS]);
+int rapl_backend_bench(struct rapl_backend *b, int reads, int interval_us, struct rapl_bench *res);
+struct rapl_backend *rapl_backend_select(void);
+
+#endif
@@ -0,0 +1,290 @@
+/* librapl power limits -- see rapl_cap.h */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rapl.h"
+#include "rapl_cap.h"
+
+#define POWERCAP_DIR "/sys/class/powercap"
+
+#define MSR_RAPL_POWER_UNIT 0x606
+#define MSR_PKG_RAPL_POWER_LIMIT 0x610
+#define MSR_PKG_POWER_INFO 0x614
+
+#define PL_POWER_MASK 0x7fffULL
+#define PL1_SHIFT 0
+#define PL2_SHIFT 32
+#define PL1_ENABLE (1ULL << 15)
+#define PL2_ENABLE (1ULL << 47)
+#define PL_LOCKED (1ULL << 63)
+
+#define UW_PER_W 1000000.0
+
+static int read_zone_uw(struct rapl_cap *cap, const char *attr, double *watts)
+{
+	char filename[BUFSIZ * 2];
+	long long uw;
+	FILE *f;
+
+	snprintf(filename, sizeof(filename), "%s/%s", cap->zone, attr);
+	if (!(f = fopen(filename, "r")))
+	{
+		return -1;
+	}
+	if (fscanf(f, "%lld", &uw) != 1)
+	{
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	*watts = (double)uw / UW_PER_W;
+	return 0;
+}
+
+static int write_zone_uw(struct rapl_cap *cap, const char *attr, double watts)
+{
+	char filename[BUFSIZ * 2];
+	FILE *f;
+	int ret;
+
+	snprintf(filename, sizeof(filename), "%s/%s", cap->zone, attr);
+	if (!(f = fopen(filename, "w")))
+	{
+		printf("could not open %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	ret = fprintf(f, "%lld\n", (long long)(watts * UW_PER_W)) < 0;
+	// sysfs reports the error on the write back to the file
+	ret |= fclose(f) != 0;
+	if (ret)
+	{
+		printf("could not write %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* top level intel-rapl:N zones are named package-<physical package id> */
+static int find_powercap_zone(struct rapl_cap *cap)
+{
+	char filename[BUFSIZ * 2], name[BUFSIZ], want[BUFSIZ];
+	struct dirent *e;
+	DIR *dir = opendir(POWERCAP_DIR);
+	int found = -1;
+
+	if (!dir)
+	{
+		return -1;
+	}
+
+	snprintf(want, sizeof(want), "package-%d", rapl_topo.cpus[rapl_topo.package_cpu[cap->package]].package_id);
+	while (found != 0 && (e = readdir(dir)))
+	{
+		// intel-rapl:N, not the intel-rapl:N:M subzones
+		if (strncmp(e->d_name, "intel-rapl:", 11) || strchr(e->d_name + 11, ':'))
+		{
+			continue;
+		}
+
+		snprintf(filename, sizeof(filename), POWERCAP_DIR "/%s/name", e->d_name);
+		FILE *f = fopen(filename, "r");
+		if (!f)
+		{
+			continue;
+		}
+		if (fscanf(f, "%s", name) == 1 && !strcmp(name, want))
+		{
+			snprintf(cap->zone, sizeof(cap->zone), POWERCAP_DIR "/%s", e->d_name);
+			found = 0;
+		}
+		fclose(f);
+	}
+	closedir(dir);
+
+	return found;
+}
+
+static int read_msr(int fd, int which, uint64_t *data)
+{
+	return pread(fd, data, sizeof(*data), which) == sizeof(*data) ? 0 : -1;
+}
+
+static int open_msr_backend(struct rapl_cap *cap)
+{
+	char filename[BUFSIZ];
+	uint64_t units, info;
+
+	snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", rapl_topo.package_cpu[cap->package]);
+	cap->msr_fd = open(filename, O_RDWR);
+	if (cap->msr_fd < 0)
+	{
+		printf("could not open %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	if (read_msr(cap->msr_fd, MSR_RAPL_POWER_UNIT, &units) != 0 ||
+		read_msr(cap->msr_fd, MSR_PKG_RAPL_POWER_LIMIT, &cap->saved_msr) != 0)
+	{
+		printf("could not read the package power limit msrs: %s\n", strerror(errno));
+		close(cap->msr_fd);
+		return -1;
+	}
+
+	if (cap->saved_msr & PL_LOCKED)
+	{
+		printf("package %d power limits are locked\n", cap->package);
+		close(cap->msr_fd);
+		return -1;
+	}
+
+	cap->power_units = 1.0 / (double)(1 << (units & 0xf));
+	if (read_msr(cap->msr_fd, MSR_PKG_POWER_INFO, &info) == 0)
+	{
+		cap->min_power = cap->power_units * (double)((info >> 16) & PL_POWER_MASK);
+		cap->max_power = cap->power_units * (double)((info >> 32) & PL_POWER_MASK);
+	}
+
+	return 0;
+}
+
+/*
+ * Prefers powercap, which validates the limits and keeps the kernel's view
+ * of them consistent, and falls back to the msr. Returns -1 if neither can
+ * be opened for writing.
+ */
+int rapl_cap_open(struct rapl_cap *cap, int package)
+{
+	memset(cap, 0, sizeof(*cap));
+	cap->package = package;
+	cap->msr_fd = -1;
+
+	if (find_powercap_zone(cap) == 0)
+	{
+		double pl2;
+
+		cap->backend = RAPL_CAP_POWERCAP;
+		cap->has_pl2 = read_zone_uw(cap, "constraint_1_power_limit_uw", &pl2) == 0;
+		read_zone_uw(cap, "constraint_0_max_power_uw", &cap->max_power);
+	}
+	else if (open_msr_backend(cap) == 0)
+	{
+		cap->backend = RAPL_CAP_MSR;
+		cap->has_pl2 = true;
+	}
+	else
+	{
+		printf("no writable power limits for package %d\n", package);
+		return -1;
+	}
+
+	if (rapl_cap_get(cap, &cap->saved_pl1, &cap->saved_pl2) != 0)
+	{
+		printf("could not read the power limits of package %d\n", package);
+		rapl_cap_close(cap);
+		return -1;
+	}
+
+	return 0;
+}
+
+int rapl_cap_get(struct rapl_cap *cap, double *pl1, double *pl2)
+{
+	uint64_t limit;
+
+	if (cap->backend == RAPL_CAP_POWERCAP)
+	{
+		if (read_zone_uw(cap, "constraint_0_power_limit_uw", pl1) != 0)
+		{
+			return -1;
+		}
+		// not every package has a short term constraint
+		if (!cap->has_pl2 || read_zone_uw(cap, "constraint_1_power_limit_uw", pl2) != 0)
+		{
+			*pl2 = *pl1;
+		}
+		return 0;
+	}
+
+	if (read_msr(cap->msr_fd, MSR_PKG_RAPL_POWER_LIMIT, &limit) != 0)
+	{
+		return -1;
+	}
+	*pl1 = cap->power_units * (double)((limit >> PL1_SHIFT) & PL_POWER_MASK);
+	*pl2 = cap->power_units * (double)((limit >> PL2_SHIFT) & PL_POWER_MASK);
+
+	return 0;
+}
+
+/* Sets and enables both limits, leaving time windows and clamping alone */
+int rapl_cap_set(struct rapl_cap *cap, double pl1, double pl2)
+{
+	uint64_t limit, pl1_raw, pl2_raw;
+
+	if (cap->backend == RAPL_CAP_POWERCAP)
+	{
+		if (write_zone_uw(cap, "constraint_0_power_limit_uw", pl1) != 0)
+		{
+			return -1;
+		}
+		if (cap->has_pl2)
+		{
+			return write_zone_uw(cap, "constraint_1_power_limit_uw", pl2);
+		}
+		return 0;
+	}
+
+	if (read_msr(cap->msr_fd, MSR_PKG_RAPL_POWER_LIMIT, &limit) != 0)
+	{
+		return -1;
+	}
+
+	pl1_raw = (uint64_t)(pl1 / cap->power_units) & PL_POWER_MASK;
+	pl2_raw = (uint64_t)(pl2 / cap->power_units) & PL_POWER_MASK;
+	limit &= ~((PL_POWER_MASK << PL1_SHIFT) | (PL_POWER_MASK << PL2_SHIFT));
+	limit |= (pl1_raw << PL1_SHIFT) | (pl2_raw << PL2_SHIFT) | PL1_ENABLE | PL2_ENABLE;
+
+	if (pwrite(cap->msr_fd, &limit, sizeof(limit), MSR_PKG_RAPL_POWER_LIMIT) != sizeof(limit))
+	{
+		printf("could not write the package %d power limit msr: %s\n", cap->package, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Restores the limits found at open */
+int rapl_cap_close(struct rapl_cap *cap)
+{
+	int ret = 0;
+
+	if (cap->backend == RAPL_CAP_POWERCAP)
+	{
+		if (cap->saved_pl1 > 0.0)
+		{
+			ret = rapl_cap_set(cap, cap->saved_pl1, cap->saved_pl2);
+		}
+		return ret;
+	}
+
+	if (cap->msr_fd < 0)
+	{
+		return 0;
+	}
+	if (pwrite(cap->msr_fd, &cap->saved_msr, sizeof(cap->saved_msr), MSR_PKG_RAPL_POWER_LIMIT) != sizeof(cap->saved_msr))
+	{
+		printf("could not restore the package %d power limit msr: %s\n", cap->package, strerror(errno));
+		ret = -1;
+	}
+	close(cap->msr_fd);
+	cap->msr_fd = -1;
+
+	return ret;
+}
@@ -0,0 +1,41 @@
+/* Package power limits (PL1/PL2)
+
+Sets the long term (PL1) and short term (PL2) package power limits
+through the powercap sysfs interface, or through MSR_PKG_RAPL_POWER_LIMIT
+when intel_rapl isn't loaded. The limits found at open are remembered so
+rapl_cap_close() can put them back.
+
+Writing either needs root. */
+
+#ifndef _RAPL_CAP_H
+#define _RAPL_CAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum rapl_cap_backend
+{
+	RAPL_CAP_POWERCAP,
+	RAPL_CAP_MSR,
+};
+
+struct rapl_cap
+{
+	enum rapl_cap_backend backend;
+	int package;
+	bool has_pl2;
+	char zone[BUFSIZ];	// powercap: /sys/class/powercap/intel-rapl:N
+	int msr_fd;			// msr: /dev/cpu/<first cpu of package>/msr
+	double power_units; // msr: Watts per count
+	uint64_t saved_msr;
+	double saved_pl1, saved_pl2; // Watts
+	double min_power, max_power; // Watts, 0 if unknown
+};
+
+int rapl_cap_open(struct rapl_cap *cap, int package);
+int rapl_cap_get(struct rapl_cap *cap, double *pl1, double *pl2);
+int rapl_cap_set(struct rapl_cap *cap, double pl1, double pl2);
+int rapl_cap_close(struct rapl_cap *cap);
+
+#endif
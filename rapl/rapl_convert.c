@@ -0,0 +1,344 @@
+/* Converts a binary trace written by rapl -d -o into CSV or a columnar file
+
+CSV has one row per record:
+	time,package,domain,raw,energy_j,power_w
+with time in seconds since the epoch, energy since the first record of
+that package and domain, and power since its previous record.
+
+The columnar format is
+	char magic[8] = "RAPLCOL1"
+	uint64_t rows
+	uint64_t time_ns[rows]   CLOCK_REALTIME
+	uint16_t package[rows]
+	uint16_t domain[rows]
+	double energy_j[rows]    since the first record of the series
+so each column can be loaded with a single read.
+
+Both leave out the APERF/MPERF records of rapl -d -f, which -f freq turns
+into one CSV row per cpu and sample instead:
+	time,package,cpu,freq_mhz,busy_pct,aperf_mperf
+with the effective frequency while busy and the share of the interval
+in C0 since that cpu's previous sample, as in rapl_freq.h. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rapl.h"
+#include "rapl_trace.h"
+
+#define NSEC_PER_SEC 1000000000L
+#define COLUMNAR_MAGIC "RAPLCOL1"
+
+struct trace
+{
+	const struct rapl_trace_header *header;
+	const struct rapl_trace_domain *domains;
+	const struct rapl_trace_record *records;
+	size_t nr_records;
+};
+
+struct series
+{
+	uint64_t first, last, last_time_ns;
+	int seen;
+};
+
+struct cpu_series
+{
+	uint64_t aperf, mperf, time_ns; // previous sample
+	uint64_t next_aperf;			// APERF of the sample being read
+	int seen;
+};
+
+static int map_trace(const char *path, struct trace *t)
+{
+	struct stat st;
+	const char *base;
+	size_t offset;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		fprintf(stderr, "could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(struct rapl_trace_header))
+	{
+		fprintf(stderr, "%s is not a rapl trace\n", path);
+		return -1;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		fprintf(stderr, "could not map %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	t->header = (const struct rapl_trace_header *)base;
+	if (memcmp(t->header->magic, RAPL_TRACE_MAGIC, sizeof(t->header->magic)) ||
+		t->header->version > RAPL_TRACE_VERSION ||
+		t->header->record_size != sizeof(struct rapl_trace_record))
+	{
+		fprintf(stderr, "%s is not a version 1 to %d rapl trace\n", path, RAPL_TRACE_VERSION);
+		return -1;
+	}
+
+	offset = sizeof(struct rapl_trace_header) + t->header->nr_domains * sizeof(struct rapl_trace_domain);
+	if (offset > (size_t)st.st_size)
+	{
+		fprintf(stderr, "%s is truncated\n", path);
+		return -1;
+	}
+	t->domains = (const struct rapl_trace_domain *)(base + sizeof(struct rapl_trace_header));
+	t->records = (const struct rapl_trace_record *)(base + offset);
+	t->nr_records = (st.st_size - offset) / sizeof(struct rapl_trace_record);
+
+	return 0;
+}
+
+static struct series *get_series(struct series *series, const struct trace *t, const struct rapl_trace_record *r)
+{
+	if (r->package >= MAX_PACKAGES || r->domain >= t->header->nr_domains)
+	{
+		return NULL;
+	}
+	return &series[r->package * t->header->nr_domains + r->domain];
+}
+
+static double series_energy(const struct trace *t, const struct rapl_trace_record *r, struct series *s)
+{
+	if (!s->seen)
+	{
+		s->first = r->raw;
+		s->seen = 1;
+	}
+	return (double)(r->raw - s->first) * t->domains[r->domain].scale;
+}
+
+static void write_csv(const struct trace *t, FILE *out)
+{
+	struct series *series = calloc(MAX_PACKAGES * t->header->nr_domains, sizeof(*series));
+
+	fprintf(out, "time,package,domain,raw,energy_j,power_w\n");
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		const struct rapl_trace_record *r = &t->records[n];
+		struct series *s = get_series(series, t, r);
+		double power = 0.0, energy;
+		int64_t real_ns = (int64_t)r->time_ns + t->header->realtime_offset_ns;
+
+		if (!s)
+		{
+			continue;
+		}
+		if (s->seen && r->time_ns > s->last_time_ns)
+		{
+			power = (double)(r->raw - s->last) * t->domains[r->domain].scale /
+					((double)(r->time_ns - s->last_time_ns) / NSEC_PER_SEC);
+		}
+		energy = series_energy(t, r, s);
+		s->last = r->raw;
+		s->last_time_ns = r->time_ns;
+
+		fprintf(out, "%lld.%09lld,%u,%s,%llu,%.9f,%.6f\n",
+				(long long)(real_ns / NSEC_PER_SEC), (long long)(real_ns % NSEC_PER_SEC),
+				r->package, t->domains[r->domain].name, (unsigned long long)r->raw, energy, power);
+	}
+
+	free(series);
+}
+
+static void write_columnar(const struct trace *t, FILE *out)
+{
+	struct series *series = calloc(MAX_PACKAGES * t->header->nr_domains, sizeof(*series));
+	uint64_t rows = 0;
+
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		rows += get_series(series, t, &t->records[n]) != NULL;
+	}
+
+	fwrite(COLUMNAR_MAGIC, 1, 8, out);
+	fwrite(&rows, sizeof(rows), 1, out);
+
+	// one pass over the records per column
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		if (get_series(series, t, &t->records[n]))
+		{
+			uint64_t real_ns = t->records[n].time_ns + t->header->realtime_offset_ns;
+			fwrite(&real_ns, sizeof(real_ns), 1, out);
+		}
+	}
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		if (get_series(series, t, &t->records[n]))
+		{
+			fwrite(&t->records[n].package, sizeof(uint16_t), 1, out);
+		}
+	}
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		if (get_series(series, t, &t->records[n]))
+		{
+			fwrite(&t->records[n].domain, sizeof(uint16_t), 1, out);
+		}
+	}
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		struct series *s = get_series(series, t, &t->records[n]);
+		if (s)
+		{
+			double energy = series_energy(t, &t->records[n], s);
+			fwrite(&energy, sizeof(energy), 1, out);
+		}
+	}
+
+	free(series);
+}
+
+static int write_freq(const struct trace *t, FILE *out)
+{
+	double tsc_hz = (double)t->header->tsc_khz * 1000.0;
+	struct cpu_series *cpus;
+	uint32_t nr_cpus = 0;
+
+	if (t->header->version < 2 || !t->header->tsc_khz)
+	{
+		fprintf(stderr, "the trace has no APERF/MPERF records, record it with rapl -d -f -o\n");
+		return -1;
+	}
+
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		if (t->records[n].domain == RAPL_TRACE_MPERF && t->records[n].cpu >= nr_cpus)
+		{
+			nr_cpus = t->records[n].cpu + 1;
+		}
+	}
+	cpus = calloc(nr_cpus ? nr_cpus : 1, sizeof(*cpus));
+	if (!cpus)
+	{
+		return -1;
+	}
+
+	fprintf(out, "time,package,cpu,freq_mhz,busy_pct,aperf_mperf\n");
+	for (size_t n = 0; n < t->nr_records; n++)
+	{
+		const struct rapl_trace_record *r = &t->records[n];
+		struct cpu_series *c;
+		double da, dm, dt, ratio, busy;
+		int64_t real_ns = (int64_t)r->time_ns + t->header->realtime_offset_ns;
+
+		// the daemon writes APERF then MPERF of a cpu, with one time
+		if (r->domain == RAPL_TRACE_APERF && r->cpu < nr_cpus)
+		{
+			cpus[r->cpu].next_aperf = r->raw;
+			continue;
+		}
+		if (r->domain != RAPL_TRACE_MPERF)
+		{
+			continue;
+		}
+
+		c = &cpus[r->cpu];
+		if (c->seen && r->time_ns > c->time_ns)
+		{
+			da = (double)(c->next_aperf - c->aperf);
+			dm = (double)(r->raw - c->mperf);
+			dt = (double)(r->time_ns - c->time_ns) / NSEC_PER_SEC;
+			ratio = dm > 0.0 ? da / dm : 0.0;
+			busy = 100.0 * dm / (dt * tsc_hz);
+
+			fprintf(out, "%lld.%09lld,%u,%u,%.0f,%.1f,%.3f\n",
+					(long long)(real_ns / NSEC_PER_SEC), (long long)(real_ns % NSEC_PER_SEC),
+					r->package, r->cpu, ratio * tsc_hz / 1e6, busy > 100.0 ? 100.0 : busy, ratio);
+		}
+		c->aperf = c->next_aperf;
+		c->mperf = r->raw;
+		c->time_ns = r->time_ns;
+		c->seen = 1;
+	}
+
+	free(cpus);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace t;
+	const char *format = "csv", *output = NULL;
+	FILE *out = stdout;
+	int c;
+
+	while ((c = getopt(argc, argv, "f:ho:")) != -1)
+	{
+		switch (c)
+		{
+		case 'f':
+			format = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'h':
+		default:
+			printf("Usage: %s [-f csv|columnar|freq] [-o output] trace\n", argv[0]);
+			exit(c == 'h' ? 0 : -1);
+		}
+	}
+
+	if (optind >= argc)
+	{
+		printf("Usage: %s [-f csv|columnar|freq] [-o output] trace\n", argv[0]);
+		exit(-1);
+	}
+
+	if (map_trace(argv[optind], &t) != 0)
+	{
+		exit(-1);
+	}
+
+	if (output && !(out = fopen(output, "w")))
+	{
+		fprintf(stderr, "could not create %s: %s\n", output, strerror(errno));
+		exit(-1);
+	}
+
+	if (!strcmp(format, "csv"))
+	{
+		write_csv(&t, out);
+	}
+	else if (!strcmp(format, "columnar"))
+	{
+		write_columnar(&t, out);
+	}
+	else if (!strcmp(format, "freq"))
+	{
+		if (write_freq(&t, out) != 0)
+		{
+			exit(-1);
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Unknown format %s\n", format);
+		exit(-1);
+	}
+
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+
+	return 0;
+}
@@ -0,0 +1,341 @@
+/* librapl C-state residency -- see rapl_cstate.h */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rapl.h"
+#include "rapl_cstate.h"
+#include "rapl_freq.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define USEC_PER_SEC 1000000LL
+
+const char *rapl_cstate_pkg_names[RAPL_NR_PKG_CSTATES] = {
+	"pc2",
+	"pc3",
+	"pc6",
+	"pc7",
+	"pc8",
+	"pc9",
+	"pc10",
+};
+
+const char *rapl_cstate_core_names[RAPL_NR_CORE_CSTATES] = {
+	"cc3",
+	"cc6",
+	"cc7",
+};
+
+static const int pkg_msrs[RAPL_NR_PKG_CSTATES] = {
+	0x60d, // MSR_PKG_C2_RESIDENCY
+	0x3f8, // MSR_PKG_C3_RESIDENCY
+	0x3f9, // MSR_PKG_C6_RESIDENCY
+	0x3fa, // MSR_PKG_C7_RESIDENCY
+	0x630, // MSR_PKG_C8_RESIDENCY
+	0x631, // MSR_PKG_C9_RESIDENCY
+	0x632, // MSR_PKG_C10_RESIDENCY
+};
+
+static const int core_msrs[RAPL_NR_CORE_CSTATES] = {
+	0x3fc, // MSR_CORE_C3_RESIDENCY
+	0x3fd, // MSR_CORE_C6_RESIDENCY
+	0x3fe, // MSR_CORE_C7_RESIDENCY
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int read_msr(int fd, int which, uint64_t *data)
+{
+	return pread(fd, data, sizeof(*data), which) == sizeof(*data) ? 0 : -1;
+}
+
+static int read_counter(int fd, uint64_t *value)
+{
+	char buf[32];
+	ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+
+	if (n <= 0)
+	{
+		return -1;
+	}
+	buf[n] = '\0';
+	*value = strtoull(buf, NULL, 10);
+
+	return 0;
+}
+
+/* cpus whose msr we read: the first of each package and thread 0 of each core */
+static bool reads_msr(int cpu)
+{
+	struct topology_cpu *t = &rapl_topo.cpus[cpu];
+
+	return t->online && (t->thread == 0 || rapl_topo.package_cpu[t->package] == cpu);
+}
+
+static int open_msrs(struct rapl_cstate *c)
+{
+	char filename[BUFSIZ];
+
+	for (int cpu = 0; cpu < c->nr_cpus; cpu++)
+	{
+		if (!reads_msr(cpu))
+		{
+			continue;
+		}
+		snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", cpu);
+		if ((c->fd[cpu] = open(filename, O_RDONLY)) < 0)
+		{
+			printf("could not open %s: %s, no residency counters\n", filename, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* finds the states the msrs count and takes their baselines */
+static void probe_msrs(struct rapl_cstate *c)
+{
+	uint64_t raw;
+
+	// a state is only reported if every package and core has it
+	for (int i = 0; i < RAPL_NR_PKG_CSTATES; i++)
+	{
+		c->pkg_available[i] = true;
+		for (int j = 0; j < rapl_topo.nr_packages && c->pkg_available[i]; j++)
+		{
+			c->pkg_available[i] = read_msr(c->fd[rapl_topo.package_cpu[j]], pkg_msrs[i], &c->last_pkg[j][i]) == 0;
+		}
+	}
+	for (int i = 0; i < RAPL_NR_CORE_CSTATES; i++)
+	{
+		c->core_available[i] = true;
+		for (int cpu = 0; cpu < c->nr_cpus && c->core_available[i]; cpu++)
+		{
+			if (reads_msr(cpu) && rapl_topo.cpus[cpu].thread == 0)
+			{
+				c->core_available[i] = read_msr(c->fd[cpu], core_msrs[i], &raw) == 0;
+				c->last_core[cpu][i] = raw;
+			}
+		}
+	}
+}
+
+static void open_cpuidle(struct rapl_cstate *c)
+{
+	char filename[BUFSIZ];
+	FILE *f;
+
+	for (int k = 0; k < RAPL_MAX_IDLE_STATES; k++)
+	{
+		snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/name",
+				 rapl_topo.package_cpu[0], k);
+		if (!(f = fopen(filename, "r")))
+		{
+			break;
+		}
+		if (fscanf(f, "%15s", c->idle_names[k]) != 1)
+		{
+			fclose(f);
+			break;
+		}
+		fclose(f);
+		c->nr_idle_states = k + 1;
+	}
+
+	for (int cpu = 0; cpu < c->nr_cpus; cpu++)
+	{
+		for (int k = 0; rapl_topo.cpus[cpu].online && k < c->nr_idle_states; k++)
+		{
+			snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/usage", cpu, k);
+			c->usage_fd[cpu][k] = open(filename, O_RDONLY);
+			snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/time", cpu, k);
+			c->time_fd[cpu][k] = open(filename, O_RDONLY);
+
+			if (c->usage_fd[cpu][k] < 0 || c->time_fd[cpu][k] < 0 ||
+				read_counter(c->usage_fd[cpu][k], &c->last_usage[cpu][k]) != 0 ||
+				read_counter(c->time_fd[cpu][k], &c->last_time_us[cpu][k]) != 0)
+			{
+				printf("could not read %s: %s\n", filename, strerror(errno));
+				c->nr_idle_states = 0;
+				return;
+			}
+		}
+	}
+}
+
+int rapl_cstate_open(struct rapl_cstate *c)
+{
+	bool any = false;
+
+	memset(c, 0, sizeof(*c));
+	c->nr_cpus = rapl_topo.nr_cpus;
+	c->fd = malloc(c->nr_cpus * sizeof(*c->fd));
+	c->last_core = calloc(c->nr_cpus, sizeof(*c->last_core));
+	c->usage_fd = malloc(c->nr_cpus * sizeof(*c->usage_fd));
+	c->time_fd = malloc(c->nr_cpus * sizeof(*c->time_fd));
+	c->last_usage = calloc(c->nr_cpus, sizeof(*c->last_usage));
+	c->last_time_us = calloc(c->nr_cpus, sizeof(*c->last_time_us));
+	if (!c->fd || !c->last_core || !c->usage_fd || !c->time_fd || !c->last_usage || !c->last_time_us)
+	{
+		rapl_cstate_close(c);
+		return -1;
+	}
+	for (int cpu = 0; cpu < c->nr_cpus; cpu++)
+	{
+		c->fd[cpu] = -1;
+		for (int k = 0; k < RAPL_MAX_IDLE_STATES; k++)
+		{
+			c->usage_fd[cpu][k] = c->time_fd[cpu][k] = -1;
+		}
+	}
+
+	// calibrate first, it spins for 50 ms that must not land in the first interval
+	if (open_msrs(c) == 0)
+	{
+		c->tsc_hz = rapl_tsc_hz();
+		probe_msrs(c);
+	}
+	open_cpuidle(c);
+
+	for (int i = 0; i < RAPL_NR_PKG_CSTATES; i++)
+	{
+		any = any || c->pkg_available[i];
+	}
+	for (int i = 0; i < RAPL_NR_CORE_CSTATES; i++)
+	{
+		any = any || c->core_available[i];
+	}
+	if (!any && c->nr_idle_states == 0)
+	{
+		printf("no C-state residency counters and no cpuidle states\n");
+		rapl_cstate_close(c);
+		return -1;
+	}
+
+	for (int j = 0; j < MAX_PACKAGES; j++)
+	{
+		c->last_ns[j] = now_ns();
+	}
+
+	return 0;
+}
+
+/* Residency of package's states since the previous call for package */
+int rapl_cstate_sample(struct rapl_cstate *c, int package, struct rapl_cstate_sample *s)
+{
+	uint64_t raw, usage, time_us, now = now_ns();
+	double dt = (double)(now - c->last_ns[package]) / NSEC_PER_SEC;
+	double ticks = dt * c->tsc_hz;
+	int cores = 0, cpus = 0;
+
+	memset(s, 0, sizeof(*s));
+	c->last_ns[package] = now;
+	if (dt <= 0.0)
+	{
+		return -1;
+	}
+
+	for (int i = 0; i < RAPL_NR_PKG_CSTATES; i++)
+	{
+		if (!c->pkg_available[i])
+		{
+			continue;
+		}
+		if (read_msr(c->fd[rapl_topo.package_cpu[package]], pkg_msrs[i], &raw) != 0)
+		{
+			return -1;
+		}
+		s->pkg[i] = 100.0 * (double)(raw - c->last_pkg[package][i]) / ticks;
+		c->last_pkg[package][i] = raw;
+	}
+
+	for (int cpu = 0; cpu < c->nr_cpus; cpu++)
+	{
+		struct topology_cpu *t = &rapl_topo.cpus[cpu];
+
+		if (!t->online || t->package != package)
+		{
+			continue;
+		}
+
+		if (t->thread == 0 && c->fd[cpu] >= 0)
+		{
+			for (int i = 0; i < RAPL_NR_CORE_CSTATES; i++)
+			{
+				if (c->core_available[i] && read_msr(c->fd[cpu], core_msrs[i], &raw) == 0)
+				{
+					s->core[i] += 100.0 * (double)(raw - c->last_core[cpu][i]) / ticks;
+					c->last_core[cpu][i] = raw;
+				}
+			}
+			cores++;
+		}
+
+		for (int k = 0; k < c->nr_idle_states; k++)
+		{
+			if (read_counter(c->usage_fd[cpu][k], &usage) != 0 ||
+				read_counter(c->time_fd[cpu][k], &time_us) != 0)
+			{
+				return -1;
+			}
+			s->entries[k] += (double)(usage - c->last_usage[cpu][k]) / dt;
+			s->idle[k] += 100.0 * (double)(time_us - c->last_time_us[cpu][k]) / (dt * USEC_PER_SEC);
+			c->last_usage[cpu][k] = usage;
+			c->last_time_us[cpu][k] = time_us;
+		}
+		cpus++;
+	}
+
+	for (int i = 0; cores && i < RAPL_NR_CORE_CSTATES; i++)
+	{
+		s->core[i] /= cores;
+	}
+	for (int k = 0; cpus && k < c->nr_idle_states; k++)
+	{
+		s->idle[k] /= cpus;
+		s->entries[k] /= cpus;
+	}
+
+	return 0;
+}
+
+void rapl_cstate_close(struct rapl_cstate *c)
+{
+	for (int cpu = 0; cpu < c->nr_cpus; cpu++)
+	{
+		if (c->fd && c->fd[cpu] >= 0)
+		{
+			close(c->fd[cpu]);
+		}
+		for (int k = 0; c->usage_fd && c->time_fd && k < RAPL_MAX_IDLE_STATES; k++)
+		{
+			if (c->usage_fd[cpu][k] >= 0)
+			{
+				close(c->usage_fd[cpu][k]);
+			}
+			if (c->time_fd[cpu][k] >= 0)
+			{
+				close(c->time_fd[cpu][k]);
+			}
+		}
+	}
+	free(c->fd);
+	free(c->last_core);
+	free(c->usage_fd);
+	free(c->time_fd);
+	free(c->last_usage);
+	free(c->last_time_us);
+	memset(c, 0, sizeof(*c));
+}
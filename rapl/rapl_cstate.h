@@ -0,0 +1,81 @@
+/* C-state residency
+
+Two views of the same idle time, sampled over an interval:
+
+ - the hardware residency counters, package (PC2..PC10) and core
+   (CC3..CC7), which count at the TSC rate while the package or core sits
+   in that state, read through /dev/cpu/N/msr;
+ - the cpuidle usage and time counters in
+   /sys/devices/system/cpu/cpuN/cpuidle/stateK, i.e. what the idle
+   governor asked for, per cpu.
+
+A PM QoS latency cap (/dev/cpu_dma_latency) shows up in the second as
+shallower states being picked and in the first as deep package states
+disappearing. Counters that don't read on this machine are left out;
+either source alone is enough. */
+
+#ifndef _RAPL_CSTATE_H
+#define _RAPL_CSTATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rapl.h"
+
+enum rapl_cstate_pkg
+{
+	RAPL_PC2,
+	RAPL_PC3,
+	RAPL_PC6,
+	RAPL_PC7,
+	RAPL_PC8,
+	RAPL_PC9,
+	RAPL_PC10,
+	RAPL_NR_PKG_CSTATES,
+};
+
+enum rapl_cstate_core
+{
+	RAPL_CC3,
+	RAPL_CC6,
+	RAPL_CC7,
+	RAPL_NR_CORE_CSTATES,
+};
+
+#define RAPL_MAX_IDLE_STATES 16
+
+extern const char *rapl_cstate_pkg_names[RAPL_NR_PKG_CSTATES];
+extern const char *rapl_cstate_core_names[RAPL_NR_CORE_CSTATES];
+
+struct rapl_cstate
+{
+	double tsc_hz;
+	int nr_cpus;
+	int *fd; // msr per cpu, -1 if not read
+	bool pkg_available[RAPL_NR_PKG_CSTATES];
+	bool core_available[RAPL_NR_CORE_CSTATES];
+	int nr_idle_states;
+	char idle_names[RAPL_MAX_IDLE_STATES][16];
+	uint64_t last_ns[MAX_PACKAGES];
+	uint64_t last_pkg[MAX_PACKAGES][RAPL_NR_PKG_CSTATES];
+	uint64_t (*last_core)[RAPL_NR_CORE_CSTATES]; // per cpu
+	int (*usage_fd)[RAPL_MAX_IDLE_STATES];		 // per cpu, kept open
+	int (*time_fd)[RAPL_MAX_IDLE_STATES];
+	uint64_t (*last_usage)[RAPL_MAX_IDLE_STATES];
+	uint64_t (*last_time_us)[RAPL_MAX_IDLE_STATES];
+};
+
+/* residency in percent of the interval, entries per cpu and second */
+struct rapl_cstate_sample
+{
+	double pkg[RAPL_NR_PKG_CSTATES];
+	double core[RAPL_NR_CORE_CSTATES];  // averaged over the package's cores
+	double idle[RAPL_MAX_IDLE_STATES];  // averaged over the package's cpus
+	double entries[RAPL_MAX_IDLE_STATES];
+};
+
+int rapl_cstate_open(struct rapl_cstate *c);
+int rapl_cstate_sample(struct rapl_cstate *c, int package, struct rapl_cstate_sample *s);
+void rapl_cstate_close(struct rapl_cstate *c);
+
+#endif
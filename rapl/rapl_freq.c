@@ -0,0 +1,185 @@
+/* librapl effective frequency -- see rapl_freq.h */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <x86intrin.h>
+
+#include "rapl.h"
+#include "rapl_freq.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define CALIBRATE_NS (50 * 1000000LL)
+
+#define MSR_IA32_MPERF 0xe7
+#define MSR_IA32_APERF 0xe8
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* rdtsc against CLOCK_MONOTONIC over CALIBRATE_NS */
+double rapl_tsc_hz(void)
+{
+	uint64_t t0 = now_ns(), c0 = __rdtsc(), t1;
+
+	while ((t1 = now_ns()) - t0 < CALIBRATE_NS)
+	{
+	}
+
+	return (double)(__rdtsc() - c0) * NSEC_PER_SEC / (double)(t1 - t0);
+}
+
+/* raw APERF/MPERF of cpu and when they were read */
+int rapl_freq_read(struct rapl_freq *f, int cpu, struct rapl_freq_cpu *c)
+{
+	struct rapl_snapshot_cpu s;
+
+	if (f->snapshot)
+	{
+		if ((unsigned int)cpu >= f->snapshot->nr_cpus)
+		{
+			return -1;
+		}
+		rapl_snapshot_read_cpu(f->snapshot, cpu, &s);
+		c->aperf = s.aperf;
+		c->mperf = s.mperf;
+		c->time_ns = s.time_ns;
+		return s.time_ns ? 0 : -1;
+	}
+
+	if (pread(f->fd[cpu], &c->aperf, sizeof(c->aperf), MSR_IA32_APERF) != sizeof(c->aperf) ||
+		pread(f->fd[cpu], &c->mperf, sizeof(c->mperf), MSR_IA32_MPERF) != sizeof(c->mperf))
+	{
+		return -1;
+	}
+	c->time_ns = now_ns();
+
+	return 0;
+}
+
+static const struct rapl_snapshot *map_snapshot(void)
+{
+	const struct rapl_snapshot *s;
+	int fd = open("/dev/" RAPL_SNAPSHOT_DEVICE, O_RDONLY);
+
+	if (fd < 0)
+	{
+		return NULL;
+	}
+	s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED)
+	{
+		return NULL;
+	}
+	if (s->magic != RAPL_SNAPSHOT_MAGIC || s->version != RAPL_SNAPSHOT_VERSION)
+	{
+		munmap((void *)s, sizeof(*s));
+		return NULL;
+	}
+
+	return s;
+}
+
+int rapl_freq_open(struct rapl_freq *f)
+{
+	char filename[BUFSIZ];
+
+	memset(f, 0, sizeof(*f));
+	f->nr_cpus = rapl_topo.nr_cpus;
+	f->fd = malloc(f->nr_cpus * sizeof(*f->fd));
+	f->last = calloc(f->nr_cpus, sizeof(*f->last));
+	if (!f->fd || !f->last)
+	{
+		rapl_freq_close(f);
+		return -1;
+	}
+
+	for (int cpu = 0; cpu < f->nr_cpus; cpu++)
+	{
+		f->fd[cpu] = -1;
+	}
+
+	f->snapshot = map_snapshot();
+	for (int cpu = 0; !f->snapshot && cpu < f->nr_cpus; cpu++)
+	{
+		if (!rapl_topo.cpus[cpu].online)
+		{
+			continue;
+		}
+		snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", cpu);
+		if ((f->fd[cpu] = open(filename, O_RDONLY)) < 0)
+		{
+			printf("could not open %s: %s\n", filename, strerror(errno));
+			rapl_freq_close(f);
+			return -1;
+		}
+	}
+
+	f->tsc_hz = rapl_tsc_hz();
+
+	for (int cpu = 0; cpu < f->nr_cpus; cpu++)
+	{
+		if (rapl_topo.cpus[cpu].online && rapl_freq_read(f, cpu, &f->last[cpu]) != 0)
+		{
+			printf("could not read APERF/MPERF of cpu %d\n", cpu);
+			rapl_freq_close(f);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Effective frequency and busy share of cpu since the previous call */
+int rapl_freq_sample(struct rapl_freq *f, int cpu, struct rapl_freq_sample *s)
+{
+	struct rapl_freq_cpu c, *last = &f->last[cpu];
+	double da, dm, dt;
+
+	if (rapl_freq_read(f, cpu, &c) != 0)
+	{
+		return -1;
+	}
+
+	da = (double)(c.aperf - last->aperf);
+	dm = (double)(c.mperf - last->mperf);
+	dt = (double)(c.time_ns - last->time_ns) / NSEC_PER_SEC;
+	*last = c;
+
+	s->ratio = dm > 0.0 ? da / dm : 0.0;
+	s->mhz = s->ratio * f->tsc_hz / 1e6;
+	s->busy = dt > 0.0 ? 100.0 * dm / (dt * f->tsc_hz) : 0.0;
+	s->busy = s->busy > 100.0 ? 100.0 : s->busy;
+
+	return 0;
+}
+
+void rapl_freq_close(struct rapl_freq *f)
+{
+	for (int cpu = 0; f->fd && cpu < f->nr_cpus; cpu++)
+	{
+		if (f->fd[cpu] != -1)
+		{
+			close(f->fd[cpu]);
+		}
+	}
+	if (f->snapshot)
+	{
+		munmap((void *)f->snapshot, sizeof(*f->snapshot));
+	}
+	free(f->fd);
+	free(f->last);
+	memset(f, 0, sizeof(*f));
+}
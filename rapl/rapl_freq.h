@@ -0,0 +1,52 @@
+/* Effective frequency from APERF/MPERF
+
+APERF counts at the frequency a cpu actually runs at and MPERF at its
+base (TSC) frequency, both only while the cpu is in C0. Over an interval
+
+	effective MHz = TSC MHz * dAPERF / dMPERF	(while busy)
+	busy %        = 100 * dMPERF / dTSC
+
+which is what a governor's request turned into, not what it asked for.
+
+The counters come from the comm/rapl_snapshot page when that module is
+loaded, and otherwise from /dev/cpu/N/msr. The TSC rate is calibrated
+once against CLOCK_MONOTONIC, so dTSC is derived from elapsed time. */
+
+#ifndef _RAPL_FREQ_H
+#define _RAPL_FREQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rapl.h"
+#include "user-kernel.h"
+
+struct rapl_freq_cpu
+{
+	uint64_t aperf, mperf, time_ns;
+};
+
+struct rapl_freq
+{
+	int nr_cpus;
+	double tsc_hz;
+	const struct rapl_snapshot *snapshot; // NULL when reading msrs
+	int *fd;							  // per cpu, -1 if offline
+	struct rapl_freq_cpu *last;
+};
+
+struct rapl_freq_sample
+{
+	double mhz;	   // average effective frequency while busy
+	double busy;   // percent of the interval in C0
+	double ratio;  // dAPERF/dMPERF
+};
+
+double rapl_tsc_hz(void);
+
+int rapl_freq_open(struct rapl_freq *f);
+int rapl_freq_read(struct rapl_freq *f, int cpu, struct rapl_freq_cpu *c);
+int rapl_freq_sample(struct rapl_freq *f, int cpu, struct rapl_freq_sample *s);
+void rapl_freq_close(struct rapl_freq *f);
+
+#endif
@@ -0,0 +1,169 @@
+/* librapl sampler scheduling -- see rapl_sampler.h */
+
+#define _GNU_SOURCE // pthread_attr_setaffinity_np
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rapl.h"
+#include "rapl_sampler.h"
+
+#define NSEC_PER_SEC 1000000000LL
+#define MAX_EDGES 64
+
+static long long timespec_ns(const struct timespec *ts)
+{
+	return (long long)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/*
+ * Starts fn on a thread bound to cpu (RAPL_SAMPLER_ANY_CPU leaves it
+ * unbound), under SCHED_FIFO at fifo_priority if that is not
+ * RAPL_SAMPLER_NO_FIFO. SCHED_FIFO needs CAP_SYS_NICE; without it the
+ * thread falls back to the default policy with a warning.
+ */
+int rapl_sampler_start(pthread_t *thread, int cpu, int fifo_priority, void *(*fn)(void *), void *arg)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	cpu_set_t cpus;
+	int ret;
+
+	pthread_attr_init(&attr);
+
+	if (cpu != RAPL_SAMPLER_ANY_CPU)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+
+	if (fifo_priority != RAPL_SAMPLER_NO_FIFO)
+	{
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = fifo_priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	ret = pthread_create(thread, &attr, fn, arg);
+	if (ret == EPERM && fifo_priority != RAPL_SAMPLER_NO_FIFO)
+	{
+		printf("no permission for SCHED_FIFO, sampling at normal priority\n");
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		ret = pthread_create(thread, &attr, fn, arg);
+	}
+	pthread_attr_destroy(&attr);
+
+	if (ret != 0)
+	{
+		printf("could not start the sampler thread: %s\n", strerror(ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* returns 0 at the deadline, -1 if a signal got there first */
+int rapl_sleep_until(const struct timespec *deadline)
+{
+	return clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == 0 ? 0 : -1;
+}
+
+/* relative sleep that still ends ns after the call, however often it is interrupted */
+int rapl_sleep_ns(long long ns)
+{
+	struct timespec deadline;
+	long long end;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	end = timespec_ns(&deadline) + ns;
+	deadline.tv_sec = end / NSEC_PER_SEC;
+	deadline.tv_nsec = end % NSEC_PER_SEC;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+	{
+	}
+
+	return 0;
+}
+
+/*
+ * Busy-reads package until the count of domain changes, so the sample in
+ * value was taken within one read of the update. edge is the time of that
+ * read. Returns -1 if the counter doesn't move within timeout_ns, which is
+ * what an idle domain or a backend that reports zeros looks like.
+ */
+int rapl_wait_update(struct rapl_backend *b, int package, int domain, long long value[NUM_RAPL_DOMAINS],
+					 struct timespec *edge, long long timeout_ns)
+{
+	long long first, end;
+
+	if (b->read(b, package, value) != 0)
+	{
+		return -1;
+	}
+	first = value[domain];
+
+	clock_gettime(CLOCK_MONOTONIC, edge);
+	end = timespec_ns(edge) + timeout_ns;
+
+	do
+	{
+		if (b->read(b, package, value) != 0)
+		{
+			return -1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, edge);
+		if (value[domain] != first)
+		{
+			return 0;
+		}
+	} while (timespec_ns(edge) < end);
+
+	return -1;
+}
+
+static int compare_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Median time between edges-1 consecutive updates, which is robust to the
+ * odd update that is late or skipped. Returns -1 if the counter doesn't
+ * update at least every 100 ms.
+ */
+long long rapl_update_period_ns(struct rapl_backend *b, int package, int domain, int edges)
+{
+	long long value[NUM_RAPL_DOMAINS], period[MAX_EDGES], prev = 0;
+	struct timespec edge;
+
+	edges = edges > MAX_EDGES ? MAX_EDGES : edges;
+	if (edges < 2)
+	{
+		return -1;
+	}
+
+	for (int n = 0; n < edges; n++)
+	{
+		if (rapl_wait_update(b, package, domain, value, &edge, NSEC_PER_SEC / 10) != 0)
+		{
+			return -1;
+		}
+		if (n > 0)
+		{
+			period[n - 1] = timespec_ns(&edge) - prev;
+		}
+		prev = timespec_ns(&edge);
+	}
+
+	qsort(period, edges - 1, sizeof(period[0]), compare_ll);
+	return period[(edges - 1) / 2];
+}
@@ -0,0 +1,28 @@
+/* Sampler scheduling
+
+RAPL counters don't tick continuously, the hardware updates them about
+once a millisecond. A sample taken at an arbitrary point inside that
+update interval sees energy up to the last update only, so short windows
+are off by up to one update at each end. These helpers run the sampler on
+a pinned (optionally SCHED_FIFO) thread, sleep on absolute deadlines and
+find the update edges so that samples can be taken right after them. */
+
+#ifndef _RAPL_SAMPLER_H
+#define _RAPL_SAMPLER_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include "rapl_backend.h"
+
+#define RAPL_SAMPLER_ANY_CPU -1
+#define RAPL_SAMPLER_NO_FIFO 0
+
+int rapl_sampler_start(pthread_t *thread, int cpu, int fifo_priority, void *(*fn)(void *), void *arg);
+int rapl_sleep_until(const struct timespec *deadline);
+int rapl_sleep_ns(long long ns);
+int rapl_wait_update(struct rapl_backend *b, int package, int domain, long long value[NUM_RAPL_DOMAINS],
+					 struct timespec *edge, long long timeout_ns);
+long long rapl_update_period_ns(struct rapl_backend *b, int package, int domain, int edges);
+
+#endif
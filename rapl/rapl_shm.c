@@ -0,0 +1,90 @@
+/* librapl shared memory publication -- see rapl_shm.h */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rapl.h"
+#include "rapl_shm.h"
+
+/* Creates (or takes over) the segment, world readable, writable by us only */
+int rapl_shm_create(const char *name, struct rapl_shm **shm)
+{
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0)
+	{
+		printf("could not create shared memory %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+	if (ftruncate(fd, sizeof(struct rapl_shm)) != 0)
+	{
+		printf("could not size shared memory %s: %s\n", name, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	*shm = mmap(NULL, sizeof(struct rapl_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (*shm == MAP_FAILED)
+	{
+		printf("could not map shared memory %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	// a writer that died mid-sample may have left seq odd
+	atomic_store(&(*shm)->seq, 1);
+	memset(&(*shm)->sample, 0, sizeof((*shm)->sample));
+	atomic_store(&(*shm)->seq, 2);
+	(*shm)->magic = RAPL_SHM_MAGIC;
+	(*shm)->version = RAPL_SHM_VERSION;
+	(*shm)->nr_packages = rapl_total_packages;
+	(*shm)->pid = getpid();
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		snprintf((*shm)->domain_names[i], sizeof((*shm)->domain_names[i]), "%.31s", rapl_domain_names[i]);
+	}
+
+	return 0;
+}
+
+int rapl_shm_attach(const char *name, const struct rapl_shm **shm)
+{
+	struct rapl_shm *s;
+	int fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		printf("could not open shared memory %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	s = mmap(NULL, sizeof(struct rapl_shm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED)
+	{
+		printf("could not map shared memory %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	if (s->magic != RAPL_SHM_MAGIC || s->version != RAPL_SHM_VERSION)
+	{
+		printf("%s is not a version %d rapl segment\n", name, RAPL_SHM_VERSION);
+		munmap(s, sizeof(struct rapl_shm));
+		return -1;
+	}
+
+	*shm = s;
+	return 0;
+}
+
+void rapl_shm_destroy(const char *name, struct rapl_shm *shm)
+{
+	munmap(shm, sizeof(struct rapl_shm));
+	shm_unlink(name);
+}
@@ -0,0 +1,96 @@
+/* Live RAPL counters in shared memory
+
+rapl -d -S name publishes every sample into a POSIX shared memory segment
+(/dev/shm/<name>). Readers map it read-only and copy a consistent snapshot
+without any system call, however many of them there are and however often
+they look, instead of each opening its own perf or msr fds.
+
+The segment is guarded by a seqlock: the writer makes seq odd, updates the
+sample and makes seq even again. A reader copies the sample between two
+loads of seq and retries if they differ or were odd.
+
+	const struct rapl_shm *shm;
+	struct rapl_shm_sample s;
+
+	rapl_shm_attach("/rapl", &shm);
+	rapl_shm_read(shm, &s);
+	printf("%f W\n", s.domain[0][0].watts);
+
+Readers only need this header and rapl_shm.c (or librapl.a), link -lrt on
+older glibc. */
+
+#ifndef _RAPL_SHM_H
+#define _RAPL_SHM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rapl.h"
+
+#define RAPL_SHM_NAME "/rapl"
+#define RAPL_SHM_MAGIC 0x4c504152 // "RAPL"
+#define RAPL_SHM_VERSION 1
+
+struct rapl_shm_domain
+{
+	uint64_t count; // 64 bit, never wraps
+	double joules;	// since the daemon started
+	double watts;	// over the last sample interval
+};
+
+struct rapl_shm_sample
+{
+	uint64_t time_ns; // CLOCK_MONOTONIC
+	uint64_t samples;
+	struct rapl_shm_domain domain[MAX_PACKAGES][NUM_RAPL_DOMAINS];
+};
+
+struct rapl_shm
+{
+	// written once before the first sample
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_packages;
+	uint32_t available; // bit i set if domain i is measured
+	char domain_names[NUM_RAPL_DOMAINS][32];
+	double scale[NUM_RAPL_DOMAINS];
+	int32_t pid; // of the publishing daemon
+
+	_Atomic uint64_t seq;
+	struct rapl_shm_sample sample;
+};
+
+int rapl_shm_create(const char *name, struct rapl_shm **shm);
+int rapl_shm_attach(const char *name, const struct rapl_shm **shm);
+void rapl_shm_destroy(const char *name, struct rapl_shm *shm);
+
+static inline void rapl_shm_write_begin(struct rapl_shm *shm)
+{
+	atomic_fetch_add_explicit(&shm->seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+static inline void rapl_shm_write_end(struct rapl_shm *shm)
+{
+	atomic_fetch_add_explicit(&shm->seq, 1, memory_order_release);
+}
+
+/* copies the latest sample, spinning only while a write is in progress */
+static inline void rapl_shm_read(const struct rapl_shm *shm, struct rapl_shm_sample *out)
+{
+	uint64_t begin, end;
+	struct rapl_shm *s = (struct rapl_shm *)shm;
+
+	do
+	{
+		while ((begin = atomic_load_explicit(&s->seq, memory_order_acquire)) & 1)
+		{
+		}
+		memcpy(out, &shm->sample, sizeof(*out));
+		atomic_thread_fence(memory_order_acquire);
+		end = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	} while (begin != end);
+}
+
+#endif
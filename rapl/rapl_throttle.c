@@ -0,0 +1,215 @@
+/* librapl throttling monitor -- see rapl_throttle.h */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rapl.h"
+#include "rapl_throttle.h"
+
+#define MSR_RAPL_POWER_UNIT 0x606
+#define MSR_PKG_PERF_STATUS 0x613
+#define MSR_PP0_PERF_STATUS 0x63b
+#define MSR_DRAM_PERF_STATUS 0x61b
+#define MSR_IA32_PACKAGE_THERM_STATUS 0x1b1
+#define MSR_CORE_PERF_LIMIT_REASONS 0x64f
+
+#define PERF_STATUS_MASK 0xffffffffULL
+#define PERF_STATUS_RANGE (1ULL << 32)
+
+// IA32_PACKAGE_THERM_STATUS, each status bit has its sticky log bit next to it
+#define THERM_STATUS (1ULL << 0)
+#define THERM_PROCHOT (1ULL << 2)
+#define THERM_POWER_LIMIT (1ULL << 10)
+#define THERM_LOG_MASK ((1ULL << 1) | (1ULL << 3) | (1ULL << 11))
+// every log bit, thermal, prochot, critical, threshold 1 and 2, power limit
+#define THERM_ALL_LOG_MASK (THERM_LOG_MASK | (1ULL << 5) | (1ULL << 7) | (1ULL << 9))
+
+// MSR_CORE_PERF_LIMIT_REASONS, log bits are the status bits << 16
+#define LIMIT_PROCHOT (1ULL << 0)
+#define LIMIT_THERMAL (1ULL << 1)
+#define LIMIT_VR ((1ULL << 6) | (1ULL << 7))
+#define LIMIT_PL1 (1ULL << 10)
+#define LIMIT_PL2 (1ULL << 11)
+#define LIMIT_STATUS_MASK 0xffffULL
+
+const char *rapl_throttle_domain_names[RAPL_NR_THROTTLE_DOMAINS] = {
+	"pkg",
+	"pp0",
+	"dram",
+};
+
+const char *rapl_throttle_reason_names[RAPL_NR_THROTTLE_REASONS] = {
+	"prochot",
+	"thermal",
+	"pl1",
+	"pl2",
+	"power",
+	"vr",
+	"other",
+};
+
+static const int perf_status[RAPL_NR_THROTTLE_DOMAINS] = {
+	MSR_PKG_PERF_STATUS,
+	MSR_PP0_PERF_STATUS,
+	MSR_DRAM_PERF_STATUS,
+};
+
+static int read_msr(int fd, int which, uint64_t *data)
+{
+	return pread(fd, data, sizeof(*data), which) == sizeof(*data) ? 0 : -1;
+}
+
+static int write_msr(int fd, int which, uint64_t data)
+{
+	return pwrite(fd, &data, sizeof(data), which) == sizeof(data) ? 0 : -1;
+}
+
+/* Opens one msr per package and finds out which registers this model has */
+int rapl_throttle_open(struct rapl_throttle *t)
+{
+	char filename[BUFSIZ];
+	uint64_t units, raw;
+
+	memset(t, 0, sizeof(*t));
+	t->writable = true;
+	for (int j = 0; j < MAX_PACKAGES; j++)
+	{
+		t->fd[j] = -1;
+	}
+
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		snprintf(filename, sizeof(filename), "/dev/cpu/%d/msr", rapl_package_map[j]);
+		if ((t->fd[j] = open(filename, t->writable ? O_RDWR : O_RDONLY)) < 0 && t->writable)
+		{
+			t->writable = false;
+			t->fd[j] = open(filename, O_RDONLY);
+		}
+		if (t->fd[j] < 0)
+		{
+			printf("could not open %s: %s\n", filename, strerror(errno));
+			while (j--)
+			{
+				close(t->fd[j]);
+			}
+			return -1;
+		}
+	}
+
+	if (read_msr(t->fd[0], MSR_RAPL_POWER_UNIT, &units) != 0)
+	{
+		printf("no RAPL on this cpu\n");
+		rapl_throttle_close(t);
+		return -1;
+	}
+	t->time_units = pow(0.5, (double)((units >> 16) & 0xf));
+
+	for (int d = 0; d < RAPL_NR_THROTTLE_DOMAINS; d++)
+	{
+		t->available[d] = true;
+		for (int j = 0; j < rapl_total_packages && t->available[d]; j++)
+		{
+			t->available[d] = read_msr(t->fd[j], perf_status[d], &raw) == 0;
+			rapl_accumulator_init(&t->acc[j][d], PERF_STATUS_RANGE, raw & PERF_STATUS_MASK);
+		}
+	}
+	t->has_therm_status = read_msr(t->fd[0], MSR_IA32_PACKAGE_THERM_STATUS, &raw) == 0;
+	t->has_limit_reasons = rapl_vendor == RAPL_VENDOR_INTEL &&
+						   read_msr(t->fd[0], MSR_CORE_PERF_LIMIT_REASONS, &raw) == 0;
+
+	return 0;
+}
+
+/*
+ * Log bits are write-0-to-clear and status bits are read only, so like
+ * the kernel's therm_throt this writes zeros to the bits being cleared
+ * and everywhere outside the log bits, and ones to the log bits to keep.
+ * A model that refuses the write stops being written to.
+ */
+static void clear_log(struct rapl_throttle *t, int fd, int which, uint64_t value)
+{
+	if (write_msr(fd, which, value) != 0)
+	{
+		printf("could not clear logged throttle reasons, they stay set once seen\n");
+		t->writable = false;
+	}
+}
+
+/*
+ * Throttled time per domain since the previous call and the reasons that
+ * are active now or were logged in between. Log bits are cleared after
+ * reading when the msr is writable, so a short burst between two samples
+ * still shows up once.
+ */
+int rapl_throttle_sample(struct rapl_throttle *t, int package, struct rapl_throttle_sample *s)
+{
+	uint64_t raw, status;
+	int fd = t->fd[package];
+
+	memset(s, 0, sizeof(*s));
+
+	for (int d = 0; d < RAPL_NR_THROTTLE_DOMAINS; d++)
+	{
+		if (!t->available[d])
+		{
+			continue;
+		}
+		if (read_msr(fd, perf_status[d], &raw) != 0)
+		{
+			return -1;
+		}
+		s->throttled_s[d] = (double)rapl_accumulator_update(&t->acc[package][d], raw & PERF_STATUS_MASK) * t->time_units;
+	}
+
+	if (t->has_therm_status && read_msr(fd, MSR_IA32_PACKAGE_THERM_STATUS, &raw) == 0)
+	{
+		// fold each log bit onto its status bit
+		status = raw | ((raw & THERM_LOG_MASK) >> 1);
+		s->reasons |= status & THERM_STATUS ? RAPL_THROTTLE_THERMAL : 0;
+		s->reasons |= status & THERM_PROCHOT ? RAPL_THROTTLE_PROCHOT : 0;
+		s->reasons |= status & THERM_POWER_LIMIT ? RAPL_THROTTLE_POWER : 0;
+		if (t->writable && (raw & THERM_LOG_MASK))
+		{
+			clear_log(t, fd, MSR_IA32_PACKAGE_THERM_STATUS, THERM_ALL_LOG_MASK & ~(raw & THERM_LOG_MASK));
+		}
+	}
+
+	if (t->has_limit_reasons && read_msr(fd, MSR_CORE_PERF_LIMIT_REASONS, &raw) == 0)
+	{
+		status = (raw | (raw >> 16)) & LIMIT_STATUS_MASK;
+		s->reasons |= status & LIMIT_PROCHOT ? RAPL_THROTTLE_PROCHOT : 0;
+		s->reasons |= status & LIMIT_THERMAL ? RAPL_THROTTLE_THERMAL : 0;
+		s->reasons |= status & LIMIT_PL1 ? RAPL_THROTTLE_PL1 : 0;
+		s->reasons |= status & LIMIT_PL2 ? RAPL_THROTTLE_PL2 : 0;
+		s->reasons |= status & LIMIT_VR ? RAPL_THROTTLE_VR : 0;
+		s->reasons |= status & ~(LIMIT_PROCHOT | LIMIT_THERMAL | LIMIT_PL1 | LIMIT_PL2 | LIMIT_VR) ? RAPL_THROTTLE_OTHER : 0;
+		// PL1/PL2 say more than the generic notification
+		if (s->reasons & (RAPL_THROTTLE_PL1 | RAPL_THROTTLE_PL2))
+		{
+			s->reasons &= ~RAPL_THROTTLE_POWER;
+		}
+		if (t->writable && (raw >> 16))
+		{
+			// every log bit is decoded above, nothing else reads them
+			clear_log(t, fd, MSR_CORE_PERF_LIMIT_REASONS, 0);
+		}
+	}
+
+	return 0;
+}
+
+void rapl_throttle_close(struct rapl_throttle *t)
+{
+	for (int j = 0; j < rapl_total_packages; j++)
+	{
+		if (t->fd[j] >= 0)
+		{
+			close(t->fd[j]);
+		}
+		t->fd[j] = -1;
+	}
+}
@@ -0,0 +1,66 @@
+/* Throttling monitor
+
+The *_PERF_STATUS MSRs count the time a RAPL domain spent throttled to
+stay within its power limit, in RAPL time units. Sampled periodically
+their deltas give the share of each interval that was throttled. The
+package thermal status and, on Intel, the limit reasons register say
+why. Registers that don't read on this model are left out instead of
+gating on a list of models.
+
+Needs /dev/cpu/N/msr; clearing the sticky log bits needs it writable.
+The package thermal status log bits are also what the kernel's
+thermal_throttle counters (package_throttle_count and friends under
+/sys/devices/system/cpu/cpuN/thermal_throttle) are taken from: events
+cleared here before the kernel sees them are missing from its counts. */
+
+#ifndef _RAPL_THROTTLE_H
+#define _RAPL_THROTTLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rapl.h"
+#include "rapl_accumulator.h"
+
+enum rapl_throttle_domain
+{
+	RAPL_THROTTLE_PKG,
+	RAPL_THROTTLE_PP0,
+	RAPL_THROTTLE_DRAM,
+	RAPL_NR_THROTTLE_DOMAINS,
+};
+
+// bits of rapl_throttle_sample.reasons
+#define RAPL_THROTTLE_PROCHOT (1u << 0)
+#define RAPL_THROTTLE_THERMAL (1u << 1)
+#define RAPL_THROTTLE_PL1 (1u << 2)
+#define RAPL_THROTTLE_PL2 (1u << 3)
+#define RAPL_THROTTLE_POWER (1u << 4) // power limit notification, no PL1/PL2 detail
+#define RAPL_THROTTLE_VR (1u << 5)
+#define RAPL_THROTTLE_OTHER (1u << 6)
+#define RAPL_NR_THROTTLE_REASONS 7
+
+extern const char *rapl_throttle_domain_names[RAPL_NR_THROTTLE_DOMAINS];
+extern const char *rapl_throttle_reason_names[RAPL_NR_THROTTLE_REASONS];
+
+struct rapl_throttle
+{
+	int fd[MAX_PACKAGES];
+	bool writable;
+	bool available[RAPL_NR_THROTTLE_DOMAINS];
+	bool has_therm_status, has_limit_reasons;
+	double time_units; // seconds per PERF_STATUS count
+	struct rapl_accumulator acc[MAX_PACKAGES][RAPL_NR_THROTTLE_DOMAINS];
+};
+
+struct rapl_throttle_sample
+{
+	double throttled_s[RAPL_NR_THROTTLE_DOMAINS]; // since the previous sample
+	uint32_t reasons;							  // active now or logged since the previous sample
+};
+
+int rapl_throttle_open(struct rapl_throttle *t);
+int rapl_throttle_sample(struct rapl_throttle *t, int package, struct rapl_throttle_sample *s);
+void rapl_throttle_close(struct rapl_throttle *t);
+
+#endif
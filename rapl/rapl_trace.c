@@ -0,0 +1,117 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rapl.h"
+#include "rapl_trace.h"
+
+#define NSEC_PER_SEC 1000000000L
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/*
+ * Creates the trace file and writes the header and the descriptors of
+ * all NUM_RAPL_DOMAINS domains, so records can index them by position.
+ * scale is what the backend's counts are worth in Joules, 0 for domains
+ * that aren't available. tsc_hz is 0 unless APERF/MPERF are recorded.
+ */
+struct rapl_trace_writer *rapl_trace_open(const char *path, const double scale[NUM_RAPL_DOMAINS], double tsc_hz)
+{
+	struct rapl_trace_header header;
+	struct rapl_trace_domain domain;
+	struct timespec mono, real;
+	struct rapl_trace_writer *w = calloc(1, sizeof(*w));
+
+	if (!w)
+	{
+		return NULL;
+	}
+
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0)
+	{
+		printf("could not create trace %s: %s\n", path, strerror(errno));
+		free(w);
+		return NULL;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	clock_gettime(CLOCK_REALTIME, &real);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RAPL_TRACE_MAGIC, sizeof(header.magic));
+	header.version = RAPL_TRACE_VERSION;
+	header.record_size = sizeof(struct rapl_trace_record);
+	header.nr_domains = NUM_RAPL_DOMAINS;
+	header.tsc_khz = (uint32_t)(tsc_hz / 1000.0 + 0.5);
+	header.realtime_offset_ns = ((int64_t)real.tv_sec - mono.tv_sec) * NSEC_PER_SEC + (real.tv_nsec - mono.tv_nsec);
+
+	if (write_all(w->fd, &header, sizeof(header)) != 0)
+	{
+		goto fail;
+	}
+
+	for (int i = 0; i < NUM_RAPL_DOMAINS; i++)
+	{
+		memset(&domain, 0, sizeof(domain));
+		snprintf(domain.name, sizeof(domain.name), "%.31s", rapl_domain_names[i]);
+		domain.scale = scale[i];
+		if (write_all(w->fd, &domain, sizeof(domain)) != 0)
+		{
+			goto fail;
+		}
+	}
+
+	return w;
+
+fail:
+	printf("could not write trace %s: %s\n", path, strerror(errno));
+	close(w->fd);
+	free(w);
+	return NULL;
+}
+
+int rapl_trace_flush(struct rapl_trace_writer *w)
+{
+	int ret = write_all(w->fd, w->records, w->nr_records * sizeof(struct rapl_trace_record));
+
+	w->nr_records = 0;
+	return ret;
+}
+
+int rapl_trace_close(struct rapl_trace_writer *w)
+{
+	int ret = rapl_trace_flush(w);
+
+	if (close(w->fd) != 0)
+	{
+		ret = -1;
+	}
+	free(w);
+
+	return ret;
+}
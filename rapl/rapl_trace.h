@@ -0,0 +1,89 @@
+/* Binary RAPL trace format
+
+A trace is a header, one descriptor per domain, then fixed-size records
+in sampling order. Records carry the raw counter so no precision is lost
+and nothing is formatted at sample time; rapl-convert turns a trace into
+CSV or a columnar file afterwards.
+
+	struct rapl_trace_header
+	struct rapl_trace_domain [nr_domains]
+	struct rapl_trace_record [...until EOF]
+
+With rapl -d -f every sample also gets an APERF and an MPERF record per
+online cpu, raw counts again, with the cpu in the record and the TSC rate
+that turns them into a frequency in the header (version 2). Version 1
+traces are the same without them.
+
+All fields are little-endian as written by the host. */
+
+#ifndef _RAPL_TRACE_H
+#define _RAPL_TRACE_H
+
+#include <stdint.h>
+
+#include "rapl.h"
+
+#define RAPL_TRACE_MAGIC "RAPLTRC1"
+#define RAPL_TRACE_VERSION 2
+#define RAPL_TRACE_BUFFER_RECORDS 4096
+
+struct rapl_trace_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t nr_domains;
+	uint32_t tsc_khz; // for APERF/MPERF records, 0 if there are none
+	int64_t realtime_offset_ns; // CLOCK_REALTIME - CLOCK_MONOTONIC at open
+};
+
+struct rapl_trace_domain
+{
+	char name[32];
+	double scale; // raw count to Joules
+};
+
+// record domains past the energy domains
+#define RAPL_TRACE_APERF 0xfffe
+#define RAPL_TRACE_MPERF 0xffff
+
+struct rapl_trace_record
+{
+	uint64_t time_ns; // CLOCK_MONOTONIC
+	uint16_t package;
+	uint16_t domain; // index of a domain descriptor, or RAPL_TRACE_APERF/MPERF
+	uint32_t cpu;	 // APERF/MPERF records, 0 otherwise
+	uint64_t raw;
+};
+
+struct rapl_trace_writer
+{
+	int fd;
+	int nr_records;
+	struct rapl_trace_record records[RAPL_TRACE_BUFFER_RECORDS];
+};
+
+struct rapl_trace_writer *rapl_trace_open(const char *path, const double scale[NUM_RAPL_DOMAINS], double tsc_hz);
+int rapl_trace_flush(struct rapl_trace_writer *w);
+int rapl_trace_close(struct rapl_trace_writer *w);
+
+/* copies one record into the buffer, write()s only when it is full */
+static inline int rapl_trace_append_cpu(struct rapl_trace_writer *w, uint64_t time_ns, int package, int domain, int cpu, uint64_t raw)
+{
+	struct rapl_trace_record *r = &w->records[w->nr_records++];
+
+	r->time_ns = time_ns;
+	r->package = package;
+	r->domain = domain;
+	r->cpu = cpu;
+	r->raw = raw;
+
+	return w->nr_records == RAPL_TRACE_BUFFER_RECORDS ? rapl_trace_flush(w) : 0;
+}
+
+static inline int rapl_trace_append(struct rapl_trace_writer *w, uint64_t time_ns, int package, int domain, uint64_t raw)
+{
+	return rapl_trace_append_cpu(w, time_ns, package, domain, 0, raw);
+}
+
+#endif
@@ -1,9 +1,16 @@
+// Compile with:   make -C ../rapl && gcc -O2 -Wall -I../rapl -I../topology -o merge merge.c ../rapl/librapl.a -lpthread -lm
+
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#include "rapl.h"
+#include "topology.h"
+
 #define SEED  100
 #define UPPER 100
 #define LOWER  1
@@ -38,14 +45,22 @@ int main(int argc, const char* argv[])
     struct timeval start, end;
     pthread_t threads[NUM_OF_THREADS];
 
+    rapl_init();
+
     gettimeofday(&start, NULL);
+    rapl_region_begin("sort");
     create_threads(threads);
     join_threads(threads);
+    rapl_region_end("sort");
+    rapl_region_begin("merge");
     merge_sections_of_array(data, NUM_OF_THREADS, 1);
+    rapl_region_end("merge");
     gettimeofday(&end, NULL);
 
 
     print_time_elapsed(&start, &end);
+    rapl_region_report(stdout);
+    rapl_finish();
     //print_merged_array(data);
     validate_merged_array(data);
 
@@ -60,11 +75,37 @@ void initialize_arr()
     }
 }
 
+/*
+ * Each section gets its own physical core where possible, spread over the
+ * packages, so sections don't share an SMT sibling's execution units.
+ */
 void create_threads(pthread_t threads[])
 {
+    struct topology topo;
+    int cpus[NUM_OF_THREADS];
+    int pinned = topology_init(&topo) == 0;
+
+    if (pinned)
+    {
+        topology_spread(&topo, cpus, NUM_OF_THREADS);
+        topology_free(&topo);
+    }
+
     for (long i = 0; i < NUM_OF_THREADS; i++)
     {
-        int rc = pthread_create(&threads[i], NULL, thread_merge_sort, (void *) i);
+        pthread_attr_t attr;
+        cpu_set_t set;
+
+        pthread_attr_init(&attr);
+        if (pinned)
+        {
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i], &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+
+        int rc = pthread_create(&threads[i], &attr, thread_merge_sort, (void *) i);
+        pthread_attr_destroy(&attr);
         if (rc)
         {
             printf("ERROR: pthread_create(): %d\n", rc);
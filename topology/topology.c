@@ -0,0 +1,432 @@
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+#define MAX_CACHE_INDEX 16
+
+// large enough for a fully fragmented list of several thousand cpus
+static char cpulist_buf[65536];
+
+typedef int (*group_list_fn)(int cpu, int *cpus, int max);
+
+static int read_file(const char *path, char *buf, size_t len)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	ssize_t n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+	{
+		return -1;
+	}
+	buf[n] = '\0';
+
+	return n;
+}
+
+/* parses a kernel cpu list such as "0-3,8-11" into cpus, returns the count */
+static int parse_cpulist(const char *list, int *cpus, int max)
+{
+	const char *p = list;
+	char *end;
+	int n = 0;
+
+	while (*p && *p != '\n')
+	{
+		long lo = strtol(p, &end, 10), hi = lo;
+		if (end == p)
+		{
+			break;
+		}
+		if (*end == '-')
+		{
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+		}
+		for (long c = lo; c <= hi && n < max; c++)
+		{
+			cpus[n++] = c;
+		}
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	return n;
+}
+
+/* highest cpu in a cpu list, -1 if it is empty */
+static int cpulist_max(const char *list)
+{
+	const char *p = list;
+	char *end;
+	long max = -1;
+
+	while (*p && *p != '\n')
+	{
+		long c = strtol(p, &end, 10);
+		if (end == p)
+		{
+			break;
+		}
+		max = c > max ? c : max;
+		p = *end == ',' || *end == '-' ? end + 1 : end;
+	}
+
+	return max;
+}
+
+static int read_cpulist(const char *path, int *cpus, int max)
+{
+	if (read_file(path, cpulist_buf, sizeof(cpulist_buf)) < 0)
+	{
+		return -1;
+	}
+	return parse_cpulist(cpulist_buf, cpus, max);
+}
+
+static int topology_list(int cpu, const char *name, const char *fallback, int *cpus, int max)
+{
+	char path[BUFSIZ];
+	int n;
+
+	snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/%s", cpu, name);
+	n = read_cpulist(path, cpus, max);
+	if (n <= 0 && fallback)
+	{
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/%s", cpu, fallback);
+		n = read_cpulist(path, cpus, max);
+	}
+
+	return n;
+}
+
+static int package_list(int cpu, int *cpus, int max)
+{
+	return topology_list(cpu, "package_cpus_list", "core_siblings_list", cpus, max);
+}
+
+static int die_list(int cpu, int *cpus, int max)
+{
+	// die_cpus_list only exists since 5.2, one die per package before that
+	int n = topology_list(cpu, "die_cpus_list", NULL, cpus, max);
+	return n > 0 ? n : package_list(cpu, cpus, max);
+}
+
+static int core_list(int cpu, int *cpus, int max)
+{
+	return topology_list(cpu, "core_cpus_list", "thread_siblings_list", cpus, max);
+}
+
+/* the last level cache is the cache index with the highest level */
+static int llc_list(int cpu, int *cpus, int max)
+{
+	char path[BUFSIZ], buf[64];
+	int level, llc_level = -1, llc_index = -1;
+
+	for (int index = 0; index < MAX_CACHE_INDEX; index++)
+	{
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+		if (read_file(path, buf, sizeof(buf)) < 0)
+		{
+			break;
+		}
+		level = atoi(buf);
+		if (level > llc_level)
+		{
+			llc_level = level;
+			llc_index = index;
+		}
+	}
+
+	if (llc_index == -1)
+	{
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, llc_index);
+	return read_cpulist(path, cpus, max);
+}
+
+/*
+ * Gives every online cpu the dense id of its group at the int member at
+ * offset in struct topology_cpu. Only the lowest cpu of each group not yet
+ * seen reads sysfs; the rest of the group is filled in from its list. A
+ * cpu whose list can't be read becomes a group of its own.
+ * Returns the number of groups.
+ */
+static int assign_groups(struct topology *topo, size_t offset, group_list_fn list, int *scratch, int *first_cpu)
+{
+	int groups = 0;
+
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		int *id = (int *)((char *)&topo->cpus[cpu] + offset);
+		if (!topo->cpus[cpu].online || *id != -1)
+		{
+			continue;
+		}
+
+		int n = list(cpu, scratch, topo->nr_cpus);
+		if (n <= 0)
+		{
+			scratch[0] = cpu;
+			n = 1;
+		}
+
+		for (int i = 0; i < n; i++)
+		{
+			int c = scratch[i];
+			if (c >= 0 && c < topo->nr_cpus && topo->cpus[c].online)
+			{
+				*(int *)((char *)&topo->cpus[c] + offset) = groups;
+			}
+		}
+		// the triggering cpu may be missing from a bogus list
+		*id = groups;
+
+		if (first_cpu)
+		{
+			first_cpu[groups] = cpu;
+		}
+		groups++;
+	}
+
+	return groups;
+}
+
+static void assign_nodes(struct topology *topo, int *scratch)
+{
+	char path[BUFSIZ];
+	int nodes[BUFSIZ];
+	int nr_possible;
+
+	nr_possible = read_cpulist(SYSFS_NODE "/possible", nodes, BUFSIZ);
+	topo->nr_nodes = 0;
+
+	for (int i = 0; i < nr_possible; i++)
+	{
+		snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", nodes[i]);
+		int n = read_cpulist(path, scratch, topo->nr_cpus);
+		if (n <= 0)
+		{
+			continue;
+		}
+		for (int k = 0; k < n; k++)
+		{
+			if (scratch[k] >= 0 && scratch[k] < topo->nr_cpus && topo->cpus[scratch[k]].online)
+			{
+				topo->cpus[scratch[k]].node = topo->nr_nodes;
+			}
+		}
+		topo->nr_nodes++;
+	}
+
+	// no NUMA support: everything lives on one node
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		if (topo->cpus[cpu].online && topo->cpus[cpu].node == -1)
+		{
+			topo->cpus[cpu].node = 0;
+			topo->nr_nodes = topo->nr_nodes ? topo->nr_nodes : 1;
+		}
+	}
+}
+
+int topology_init(struct topology *topo)
+{
+	int *scratch, *online;
+	int n, *threads;
+	char path[BUFSIZ], buf[64];
+
+	memset(topo, 0, sizeof(*topo));
+
+	if (read_file(SYSFS_CPU "/possible", cpulist_buf, sizeof(cpulist_buf)) < 0)
+	{
+		return -1;
+	}
+	topo->nr_cpus = cpulist_max(cpulist_buf) + 1;
+
+	topo->cpus = calloc(topo->nr_cpus, sizeof(*topo->cpus));
+	topo->package_cpu = calloc(topo->nr_cpus, sizeof(*topo->package_cpu));
+	scratch = calloc(topo->nr_cpus, sizeof(*scratch));
+	online = calloc(topo->nr_cpus, sizeof(*online));
+	if (!topo->cpus || !topo->package_cpu || !scratch || !online)
+	{
+		free(scratch);
+		free(online);
+		topology_free(topo);
+		return -1;
+	}
+
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		struct topology_cpu *c = &topo->cpus[cpu];
+		c->package_id = c->package = c->die = c->core = c->thread = c->llc = c->node = -1;
+	}
+
+	n = read_cpulist(SYSFS_CPU "/online", online, topo->nr_cpus);
+	for (int i = 0; i < n; i++)
+	{
+		if (online[i] < topo->nr_cpus)
+		{
+			topo->cpus[online[i]].online = true;
+			topo->nr_online++;
+		}
+	}
+	free(online);
+
+	topo->nr_packages = assign_groups(topo, offsetof(struct topology_cpu, package), package_list, scratch, topo->package_cpu);
+	topo->nr_dies = assign_groups(topo, offsetof(struct topology_cpu, die), die_list, scratch, NULL);
+	topo->nr_cores = assign_groups(topo, offsetof(struct topology_cpu, core), core_list, scratch, NULL);
+	topo->nr_llcs = assign_groups(topo, offsetof(struct topology_cpu, llc), llc_list, scratch, NULL);
+	assign_nodes(topo, scratch);
+	free(scratch);
+
+	// one physical_package_id read per package, not per cpu
+	for (int p = 0; p < topo->nr_packages; p++)
+	{
+		int id = p;
+		snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", topo->package_cpu[p]);
+		if (read_file(path, buf, sizeof(buf)) >= 0)
+		{
+			id = atoi(buf);
+		}
+		for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+		{
+			if (topo->cpus[cpu].package == p)
+			{
+				topo->cpus[cpu].package_id = id;
+			}
+		}
+	}
+
+	// SMT sibling index, in cpu order within each core
+	threads = calloc(topo->nr_cores ? topo->nr_cores : 1, sizeof(*threads));
+	if (!threads)
+	{
+		topology_free(topo);
+		return -1;
+	}
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		struct topology_cpu *c = &topo->cpus[cpu];
+		if (c->online)
+		{
+			c->thread = threads[c->core]++;
+			topo->max_threads = c->thread + 1 > topo->max_threads ? c->thread + 1 : topo->max_threads;
+		}
+	}
+	free(threads);
+
+	return 0;
+}
+
+void topology_free(struct topology *topo)
+{
+	free(topo->cpus);
+	free(topo->package_cpu);
+	topo->cpus = NULL;
+	topo->package_cpu = NULL;
+}
+
+void topology_print(const struct topology *topo, FILE *f)
+{
+	fprintf(f, "Detected %d cpus (%d online) in %d packages, %d dies, %d cores, %d LLCs, %d NUMA nodes, %d threads/core\n",
+			topo->nr_cpus, topo->nr_online, topo->nr_packages, topo->nr_dies,
+			topo->nr_cores, topo->nr_llcs, topo->nr_nodes, topo->max_threads);
+}
+
+struct spread_key
+{
+	int cpu;
+	int thread;
+	int rank; // index of the core within its package
+	int package;
+};
+
+static int compare_spread(const void *a, const void *b)
+{
+	const struct spread_key *x = a, *y = b;
+
+	if (x->thread != y->thread)
+	{
+		return x->thread - y->thread;
+	}
+	if (x->rank != y->rank)
+	{
+		return x->rank - y->rank;
+	}
+	if (x->package != y->package)
+	{
+		return x->package - y->package;
+	}
+	return x->cpu - y->cpu;
+}
+
+int topology_spread(const struct topology *topo, int *cpus, int n)
+{
+	struct spread_key *keys = calloc(topo->nr_online ? topo->nr_online : 1, sizeof(*keys));
+	int *core_rank = calloc(topo->nr_cores ? topo->nr_cores : 1, sizeof(*core_rank));
+	int *package_cores = calloc(topo->nr_packages ? topo->nr_packages : 1, sizeof(*package_cores));
+	int k = 0;
+
+	if (!keys || !core_rank || !package_cores || !topo->nr_online)
+	{
+		// no map, just count up
+		for (int i = 0; i < n; i++)
+		{
+			cpus[i] = i;
+		}
+		free(keys);
+		free(core_rank);
+		free(package_cores);
+		return n;
+	}
+
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		const struct topology_cpu *c = &topo->cpus[cpu];
+		if (!c->online)
+		{
+			continue;
+		}
+		if (c->thread == 0)
+		{
+			core_rank[c->core] = package_cores[c->package]++;
+		}
+	}
+
+	for (int cpu = 0; cpu < topo->nr_cpus; cpu++)
+	{
+		const struct topology_cpu *c = &topo->cpus[cpu];
+		if (c->online)
+		{
+			keys[k].cpu = cpu;
+			keys[k].thread = c->thread;
+			keys[k].rank = core_rank[c->core];
+			keys[k].package = c->package;
+			k++;
+		}
+	}
+	qsort(keys, k, sizeof(*keys), compare_spread);
+
+	for (int i = 0; i < n; i++)
+	{
+		cpus[i] = keys[i % k].cpu;
+	}
+
+	free(keys);
+	free(core_rank);
+	free(package_cores);
+	return n;
+}
@@ -0,0 +1,52 @@
+/* CPU topology map built from /sys/devices/system/cpu
+
+Shared by rapl, rapl-read, lock and sorting. topology_init() walks sysfs
+once and, instead of opening the topology files of every cpu, reads one
+cpu list per package, die, core, LLC and NUMA node and assigns all cpus
+in it at once, so startup cost grows with the number of cores rather than
+the number of files per cpu. */
+
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct topology_cpu
+{
+	bool online;
+	int package_id; // physical_package_id as reported by the kernel
+	int package;	// dense ids below, 0..nr_*-1, -1 while offline
+	int die;
+	int core;
+	int thread; // SMT sibling index within the core
+	int llc;
+	int node;
+};
+
+struct topology
+{
+	int nr_cpus; // possible cpus, indexes cpus[]
+	int nr_online;
+	int nr_packages;
+	int nr_dies;
+	int nr_cores;
+	int nr_llcs;
+	int nr_nodes;
+	int max_threads; // SMT width
+	struct topology_cpu *cpus;
+	int *package_cpu; // first online cpu of each package
+};
+
+int topology_init(struct topology *topo);
+void topology_free(struct topology *topo);
+void topology_print(const struct topology *topo, FILE *f);
+
+/*
+ * Fills cpus[0..n-1] with online cpus ordered to spread work out: one
+ * thread per core round-robin over the packages first, SMT siblings only
+ * once every core has one. Wraps around if n > nr_online. Returns n.
+ */
+int topology_spread(const struct topology *topo, int *cpus, int n);
+
+#endif